@@ -0,0 +1,45 @@
+#include <arenaallocator.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    constexpr const char* request = R"(
+        local response = {}
+        for i = 1, 200 do response[i] = { status = i % 5, body = 'line ' .. i } end
+        return #response
+    )";
+
+    void runRequest(lat::State& lua)
+    {
+        lua.loadLibraries();
+        lua.withStack([](lat::Stack& stack) { benchmark::DoNotOptimize(stack.execute<int>(request)); });
+    }
+
+    // A state is built, runs one script and is destroyed again
+    void state_per_request_default_allocator(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            lat::State lua;
+            runRequest(lua);
+        }
+    }
+    BENCHMARK(state_per_request_default_allocator);
+
+    void state_per_request_arena_allocator(benchmark::State& state)
+    {
+        lat::ArenaAllocator arena(16 * 1024 * 1024, 256 * 1024);
+        for (auto _ : state)
+        {
+            {
+                lat::State lua(&lat::ArenaAllocator::allocate, &arena);
+                runRequest(lua);
+            }
+            arena.reset();
+        }
+    }
+    BENCHMARK(state_per_request_arena_allocator);
+}
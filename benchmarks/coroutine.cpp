@@ -0,0 +1,141 @@
+#include "raw.hpp"
+
+#include <scheduler.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+namespace
+{
+    constexpr std::string_view generator = "local n = ... while true do n = n + coroutine.yield(n) end";
+
+    void coroutine_resume(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::Base } });
+        lua.withStack([&](lat::Stack& stack) {
+            lat::Coroutine coroutine = stack.pushCoroutine(stack.pushFunction(generator));
+            for (auto _ : state)
+                benchmark::DoNotOptimize(coroutine.resume<int>(1));
+        });
+    }
+    BENCHMARK(coroutine_resume);
+
+    // Resuming through the coroutine library, as scripts had to before Coroutine existed
+    void coroutine_resume_library(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::Base } });
+        lua.withStack([&](lat::Stack& stack) {
+            lat::FunctionView resume = stack["coroutine"]["resume"];
+            lat::ObjectView coroutine = stack.execute<lat::ObjectView>(
+                "return coroutine.create(function(...) " + std::string(generator) + " end)");
+            for (auto _ : state)
+                benchmark::DoNotOptimize(resume.invoke<std::tuple<bool, int>>(coroutine, 1));
+        });
+    }
+    BENCHMARK(coroutine_resume_library);
+
+    void coroutine_resume_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        luaopen_base(lua);
+        lua_settop(lua, 0);
+        lua_State* thread = lua_newthread(lua);
+        lua.load(generator);
+        lua_xmove(lua, thread, 1);
+        for (auto _ : state)
+        {
+            lua_pushinteger(lua, 1);
+            lua_xmove(lua, thread, 1);
+            if (lua_resume(thread, 1) != LUA_YIELD)
+                throw std::runtime_error(lua_tostring(thread, -1));
+            lua_xmove(thread, lua, 1);
+            benchmark::DoNotOptimize(lua_tointeger(lua, -1));
+            lua_pop(lua, 1);
+        }
+    }
+    BENCHMARK(coroutine_resume_raw);
+
+    constexpr int taskCount = 1000;
+
+    // Every task sleeps for 100 ticks, so only 1% of them run per tick
+    void scheduler_tick(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::Base } });
+        {
+            lat::Scheduler scheduler(lua);
+            lua.withStack([&](lat::Stack& stack) {
+                scheduler.registerFunctions(stack.globals());
+                lat::FunctionView body = stack.pushFunction("while true do sleep(100) end");
+                for (int i = 0; i < taskCount; ++i)
+                {
+                    // Spread the tasks over the ticks
+                    scheduler.tick(static_cast<double>(i % 100));
+                    scheduler.spawn(body);
+                }
+            });
+            double time = 100.;
+            for (auto _ : state)
+                benchmark::DoNotOptimize(scheduler.tick(++time));
+        }
+    }
+    BENCHMARK(scheduler_tick);
+
+    // The same tasks driven from a Lua loop that resumes each one every tick
+    void scheduler_tick_lua(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::Base } });
+        lua.withStack([&](lat::Stack& stack) {
+            lat::FunctionView setup = stack.pushFunction(R"(
+                local tasks, now = {}, 0
+                local function sleep(seconds)
+                    local wake = now + seconds
+                    while now < wake do coroutine.yield() end
+                end
+                for i = 1, ...  do
+                    now = i % 100
+                    tasks[i] = coroutine.create(function() while true do sleep(100) end end)
+                    coroutine.resume(tasks[i])
+                end
+                return function(time)
+                    now = time
+                    for i = 1, #tasks do coroutine.resume(tasks[i]) end
+                end
+            )");
+            auto tick = setup.invoke<lat::FunctionView>(taskCount);
+            double time = 100.;
+            for (auto _ : state)
+                tick(++time);
+        });
+    }
+    BENCHMARK(scheduler_tick_lua);
+
+    // Bursts of short event handlers, each run as its own coroutine
+    void coroutine_spawn_short_lived(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::Base } });
+        lua.setCoroutinePoolCapacity(static_cast<std::size_t>(state.range(0)));
+        lua.withStack([&](lat::Stack& stack) {
+            lat::FunctionView handler = stack.pushFunction("local event = ... return event + 1");
+            int i = 0;
+            for (auto _ : state)
+            {
+                lat::Coroutine coroutine = stack.pushCoroutine(handler);
+                benchmark::DoNotOptimize(coroutine.resume<int>(++i));
+                coroutine.recycle();
+                stack.pop();
+            }
+        });
+    }
+    BENCHMARK(coroutine_spawn_short_lived)->Arg(0)->Arg(64);
+}
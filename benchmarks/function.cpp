@@ -0,0 +1,231 @@
+#include "raw.hpp"
+
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <new>
+#include <string_view>
+
+namespace
+{
+    constexpr int callsPerIteration = 1000;
+
+    void cpp_to_lua_call(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::FunctionView function = stack.pushFunction("local a, b = ... return a + b");
+            int i = 0;
+            for (auto _ : state)
+                benchmark::DoNotOptimize(function.invoke<double>(++i, 1.5));
+        });
+    }
+    BENCHMARK(cpp_to_lua_call);
+
+    void cpp_to_lua_call_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua.load("local a, b = ... return a + b");
+        const int function = lua_gettop(lua);
+        int i = 0;
+        for (auto _ : state)
+        {
+            lua_pushvalue(lua, function);
+            lua_pushinteger(lua, ++i);
+            lua_pushnumber(lua, 1.5);
+            lua.call(2, 1);
+            benchmark::DoNotOptimize(lua_tonumber(lua, -1));
+            lua_pop(lua, 1);
+        }
+    }
+    BENCHMARK(cpp_to_lua_call_raw);
+
+    constexpr std::string_view snippet = "local x = 0 for i = 1, 10 do x = x + i end return x";
+
+    void execute_snippet(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.setChunkCacheCapacity(static_cast<std::size_t>(state.range(0)));
+        lua.withStack([&](lat::Stack& stack) {
+            for (auto _ : state)
+                benchmark::DoNotOptimize(stack.execute<int>(snippet));
+        });
+    }
+    BENCHMARK(execute_snippet)->Arg(0)->Arg(16);
+
+    void execute_snippet_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        for (auto _ : state)
+        {
+            lua.load(snippet);
+            lua.call(0, 1);
+            benchmark::DoNotOptimize(lua_tointeger(lua, -1));
+            lua_pop(lua, 1);
+        }
+    }
+    BENCHMARK(execute_snippet_raw);
+
+    void lua_to_cpp_call(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            int total = 0;
+            stack["f"] = [&](int a, double b) {
+                total += a;
+                return b * 2.;
+            };
+            auto loop = stack.pushFunction("for i = 1, ... do f(i, 1.5) end");
+            for (auto _ : state)
+                loop(callsPerIteration);
+            benchmark::DoNotOptimize(total);
+        });
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_call);
+
+    int rawTwice(lua_State* state)
+    {
+        const auto a = static_cast<int>(luaL_checkinteger(state, 1));
+        const double b = luaL_checknumber(state, 2);
+        benchmark::DoNotOptimize(a);
+        lua_pushnumber(state, b * 2.);
+        return 1;
+    }
+
+    void lua_to_cpp_call_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua_pushcfunction(lua, &rawTwice);
+        lua_setglobal(lua, "f");
+        lua.load("for i = 1, ... do f(i, 1.5) end");
+        const int loop = lua_gettop(lua);
+        for (auto _ : state)
+        {
+            lua_pushvalue(lua, loop);
+            lua_pushinteger(lua, callsPerIteration);
+            lua.call(1, 0);
+        }
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_call_raw);
+
+    void lua_to_cpp_call_many_arguments(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack["f"] = [](int a, int b, int c, int d, int e, int f, int g, int h) {
+                return a + b + c + d + e + f + g + h;
+            };
+            auto loop = stack.pushFunction("for i = 1, ... do f(i, 2, 3, 4, 5, 6, 7, 8) end");
+            for (auto _ : state)
+                loop(callsPerIteration);
+        });
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_call_many_arguments);
+
+    struct Vector
+    {
+        double mX;
+        double mY;
+        double mZ;
+    };
+
+    void lua_to_cpp_overloaded_call(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack["v"] = Vector{};
+            stack["setPosition"] = lat::Overload([](Vector& v, double x, double y, double z) { v = { x, y, z }; },
+                [](Vector& v, const Vector& other) { v = other; }, [](Vector& v, double x) { v = { x, x, x }; },
+                [](Vector& v, std::string_view) { v = {}; });
+            auto loop = stack.pushFunction("for i = 1, ... do setPosition(v, i, 2, 3); setPosition(v, v) end");
+            for (auto _ : state)
+                loop(callsPerIteration / 2);
+        });
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_overloaded_call);
+
+    constexpr const char* rawVectorMetatable = "Vector";
+
+    int rawSetPosition(lua_State* state)
+    {
+        auto* v = static_cast<Vector*>(luaL_checkudata(state, 1, rawVectorMetatable));
+        switch (lua_gettop(state))
+        {
+            case 4:
+                *v = { luaL_checknumber(state, 2), luaL_checknumber(state, 3), luaL_checknumber(state, 4) };
+                return 0;
+            case 2:
+                if (lua_type(state, 2) == LUA_TNUMBER)
+                {
+                    const double x = lua_tonumber(state, 2);
+                    *v = { x, x, x };
+                }
+                else if (lua_type(state, 2) == LUA_TSTRING)
+                    *v = {};
+                else
+                    *v = *static_cast<Vector*>(luaL_checkudata(state, 2, rawVectorMetatable));
+                return 0;
+        }
+        return luaL_error(state, "no matching overload found");
+    }
+
+    void lua_to_cpp_overloaded_call_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        luaL_newmetatable(lua, rawVectorMetatable);
+        new (lua_newuserdata(lua, sizeof(Vector))) Vector{};
+        lua_pushvalue(lua, -2);
+        lua_setmetatable(lua, -2);
+        lua_setglobal(lua, "v");
+        lua_pushcfunction(lua, &rawSetPosition);
+        lua_setglobal(lua, "setPosition");
+        lua.load("for i = 1, ... do setPosition(v, i, 2, 3); setPosition(v, v) end");
+        const int loop = lua_gettop(lua);
+        for (auto _ : state)
+        {
+            lua_pushvalue(lua, loop);
+            lua_pushinteger(lua, callsPerIteration / 2);
+            lua.call(1, 0);
+        }
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_overloaded_call_raw);
+
+    double twice(int, double b)
+    {
+        return b * 2.;
+    }
+
+    void lua_to_cpp_bound_call(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack["f"] = lat::bind<&twice>;
+            auto loop = stack.pushFunction("for i = 1, ... do f(i, 1.5) end");
+            for (auto _ : state)
+                loop(callsPerIteration);
+        });
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_bound_call);
+
+    void lua_to_cpp_ffi_bound_call(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::JIT, lat::Library::FFI } });
+        lua.withStack([&](lat::Stack& stack) {
+            stack["f"] = lat::bindFfi<&twice>;
+            auto loop = stack.pushFunction("for i = 1, ... do f(i, 1.5) end");
+            for (auto _ : state)
+                loop(callsPerIteration);
+        });
+        state.SetItemsProcessed(state.iterations() * callsPerIteration);
+    }
+    BENCHMARK(lua_to_cpp_ffi_bound_call);
+}
@@ -0,0 +1,44 @@
+#include <poolallocator.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    // Builds and drops many small tables and strings, so most of the time goes to allocation and collection
+    constexpr const char* tableChurn = R"(
+        local items = {}
+        for i = 1, 1000 do
+            items[i] = { id = i, name = 'item' .. i, position = { x = i, y = -i } }
+        end
+        local sum = 0
+        for i = 1, #items do sum = sum + items[i].position.x end
+        return sum
+    )";
+
+    void runTableChurn(benchmark::State& state, lat::State& lua)
+    {
+        lua.loadLibraries();
+        lua.withStack([&](lat::Stack& stack) {
+            lat::FunctionView function = stack.pushFunction(tableChurn);
+            for (auto _ : state)
+                benchmark::DoNotOptimize(function.invoke<int>());
+        });
+    }
+
+    void table_churn_default_allocator(benchmark::State& state)
+    {
+        lat::State lua;
+        runTableChurn(state, lua);
+    }
+    BENCHMARK(table_churn_default_allocator);
+
+    void table_churn_pool_allocator(benchmark::State& state)
+    {
+        lat::PoolAllocator allocator(state.range(0) != 0);
+        lat::State lua(&lat::PoolAllocator::allocate, &allocator);
+        runTableChurn(state, lua);
+    }
+    BENCHMARK(table_churn_pool_allocator)->ArgName("thread_cache")->Arg(0)->Arg(1);
+}
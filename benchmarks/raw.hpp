@@ -0,0 +1,45 @@
+#ifndef LATTICE_BENCHMARKS_RAW_H
+#define LATTICE_BENCHMARKS_RAW_H
+
+#include <lua.hpp>
+
+#include <new>
+#include <stdexcept>
+#include <string_view>
+
+namespace raw
+{
+    // A bare lua_State for the hand-written C API loops each benchmark is compared against
+    class State
+    {
+        lua_State* mState;
+
+        State(const State&) = delete;
+
+    public:
+        State()
+            : mState(luaL_newstate())
+        {
+            if (mState == nullptr)
+                throw std::bad_alloc();
+        }
+
+        ~State() { lua_close(mState); }
+
+        operator lua_State*() const noexcept { return mState; }
+
+        void load(std::string_view lua)
+        {
+            if (luaL_loadbuffer(mState, lua.data(), lua.size(), "benchmark") != 0)
+                throw std::runtime_error(lua_tostring(mState, -1));
+        }
+
+        void call(int args, int results)
+        {
+            if (lua_pcall(mState, args, results, 0) != 0)
+                throw std::runtime_error(lua_tostring(mState, -1));
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "raw.hpp"
+
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    void reference_create_and_release(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::TableView table = stack.pushTable();
+            for (auto _ : state)
+            {
+                lat::Reference reference = table.store();
+                benchmark::DoNotOptimize(reference);
+            }
+        });
+    }
+    BENCHMARK(reference_create_and_release);
+
+    void reference_create_and_release_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua_newtable(lua);
+        for (auto _ : state)
+        {
+            lua_pushvalue(lua, -1);
+            const int reference = luaL_ref(lua, LUA_REGISTRYINDEX);
+            benchmark::DoNotOptimize(reference);
+            luaL_unref(lua, LUA_REGISTRYINDEX, reference);
+        }
+    }
+    BENCHMARK(reference_create_and_release_raw);
+
+    void reference_push(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::Reference reference = stack.pushTable().store();
+            stack.pop();
+            for (auto _ : state)
+            {
+                reference.pushTo(stack);
+                stack.pop();
+            }
+        });
+    }
+    BENCHMARK(reference_push);
+
+    void reference_push_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua_newtable(lua);
+        const int reference = luaL_ref(lua, LUA_REGISTRYINDEX);
+        for (auto _ : state)
+        {
+            lua_rawgeti(lua, LUA_REGISTRYINDEX, reference);
+            lua_pop(lua, 1);
+        }
+    }
+    BENCHMARK(reference_push_raw);
+}
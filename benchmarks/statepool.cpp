@@ -0,0 +1,80 @@
+#include <parallel.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+#include <statepool.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    lat::StateRecipe makeRecipe()
+    {
+        lat::StateRecipe recipe;
+        recipe.mLibraries = std::vector<lat::Library>{};
+        recipe.mChunks.push_back({ R"(
+            handlers = {}
+            for i = 1, 100 do
+                handlers[i] = function(request) return request * i end
+            end
+        )", "handlers" });
+        return recipe;
+    }
+
+    // What each request paid before: a fresh state built from the same recipe
+    void state_build_per_request(benchmark::State& state)
+    {
+        const lat::StateRecipe recipe = makeRecipe();
+        for (auto _ : state)
+        {
+            lat::State lua;
+            lua.loadLibraries(*recipe.mLibraries);
+            lua.withStack([&](lat::Stack& stack) {
+                stack.execute(recipe.mChunks[0].mSource);
+                benchmark::DoNotOptimize(stack.execute<int>("return handlers[7](6)"));
+            });
+        }
+    }
+    BENCHMARK(state_build_per_request);
+
+    void state_pool_checkout_per_request(benchmark::State& state)
+    {
+        lat::StatePool pool(makeRecipe(), 4);
+        for (auto _ : state)
+        {
+            lat::StatePool::Handle lua = pool.checkout();
+            lua->withStack([&](lat::Stack& stack) {
+                benchmark::DoNotOptimize(stack.execute<int>("return handlers[7](6)"));
+            });
+        }
+    }
+    BENCHMARK(state_pool_checkout_per_request);
+
+    constexpr std::size_t recordCount = 100000;
+    constexpr std::string_view scoreFunction = R"(
+        function score(x)
+            local s = 0
+            for i = 1, 50 do s = s + (x * i) % 7 end
+            return s
+        end
+    )";
+
+    void parallel_map(benchmark::State& state)
+    {
+        lat::StateRecipe recipe;
+        recipe.mChunks.push_back({ std::string(scoreFunction), "score" });
+        lat::StatePool pool(recipe, static_cast<std::size_t>(state.range(0)));
+        std::vector<int> records(recordCount);
+        std::iota(records.begin(), records.end(), 0);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(parallelMap<int>(pool, "score", std::span<const int>(records)));
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * recordCount));
+    }
+    BENCHMARK(parallel_map)->Arg(1)->Arg(2)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
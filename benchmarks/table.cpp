@@ -0,0 +1,219 @@
+#include "raw.hpp"
+
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    constexpr int elements = 10000;
+
+    std::vector<double> makeValues()
+    {
+        std::vector<double> values(elements);
+        for (int i = 0; i < elements; ++i)
+            values[static_cast<std::size_t>(i)] = i * .5;
+        return values;
+    }
+
+    constexpr std::string_view nestedTables = "a = { b = { c = { d = 1 } } }";
+
+    void table_deep_read(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack.execute(nestedTables);
+            for (auto _ : state)
+                benchmark::DoNotOptimize(stack["a"]["b"]["c"]["d"].get<int>());
+        });
+    }
+    BENCHMARK(table_deep_read);
+
+    void table_deep_read_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua.load(nestedTables);
+        lua.call(0, 0);
+        for (auto _ : state)
+        {
+            lua_getglobal(lua, "a");
+            lua_getfield(lua, -1, "b");
+            lua_getfield(lua, -1, "c");
+            lua_getfield(lua, -1, "d");
+            benchmark::DoNotOptimize(lua_tointeger(lua, -1));
+            lua_pop(lua, 4);
+        }
+    }
+    BENCHMARK(table_deep_read_raw);
+
+    void table_deep_write(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack.execute(nestedTables);
+            int i = 0;
+            for (auto _ : state)
+                stack["a"]["b"]["c"]["d"] = ++i;
+        });
+    }
+    BENCHMARK(table_deep_write);
+
+    void table_deep_write_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua.load(nestedTables);
+        lua.call(0, 0);
+        int i = 0;
+        for (auto _ : state)
+        {
+            lua_getglobal(lua, "a");
+            lua_getfield(lua, -1, "b");
+            lua_getfield(lua, -1, "c");
+            lua_pushinteger(lua, ++i);
+            lua_setfield(lua, -2, "d");
+            lua_pop(lua, 3);
+        }
+    }
+    BENCHMARK(table_deep_write_raw);
+
+    void table_iterate(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::TableView table = stack.push(makeValues()).asTable();
+            for (auto _ : state)
+            {
+                for (const auto& [key, value] : table)
+                    benchmark::DoNotOptimize(&value);
+            }
+        });
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_iterate);
+
+    void table_for_each(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::TableView table = stack.push(makeValues()).asTable();
+            for (auto _ : state)
+                table.forEach([](lat::ObjectView, lat::ObjectView value) { benchmark::DoNotOptimize(value); });
+        });
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_for_each);
+
+    void table_iterate_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua_createtable(lua, elements, 0);
+        for (int i = 0; i < elements; ++i)
+        {
+            lua_pushnumber(lua, i * .5);
+            lua_rawseti(lua, -2, i + 1);
+        }
+        for (auto _ : state)
+        {
+            lua_pushnil(lua);
+            while (lua_next(lua, -2) != 0)
+            {
+                benchmark::DoNotOptimize(lua_tonumber(lua, -1));
+                lua_pop(lua, 1);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_iterate_raw);
+
+    void table_fill_by_index(benchmark::State& state)
+    {
+        const std::vector<double> values = makeValues();
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            for (auto _ : state)
+            {
+                lat::TableView table = stack.pushTable();
+                for (int i = 0; i < elements; ++i)
+                    table[i + 1] = values[static_cast<std::size_t>(i)];
+                stack.pop();
+            }
+        });
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_fill_by_index);
+
+    void table_push_vector(benchmark::State& state)
+    {
+        const std::vector<double> values = makeValues();
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            for (auto _ : state)
+            {
+                stack.push(values);
+                stack.pop();
+            }
+        });
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_push_vector);
+
+    void table_push_vector_raw(benchmark::State& state)
+    {
+        const std::vector<double> values = makeValues();
+        raw::State lua;
+        for (auto _ : state)
+        {
+            lua_createtable(lua, elements, 0);
+            for (int i = 0; i < elements; ++i)
+            {
+                lua_pushnumber(lua, values[static_cast<std::size_t>(i)]);
+                lua_rawseti(lua, -2, i + 1);
+            }
+            lua_pop(lua, 1);
+        }
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_push_vector_raw);
+
+    void table_pull_vector(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::ObjectView table = stack.push(makeValues());
+            for (auto _ : state)
+                benchmark::DoNotOptimize(table.as<std::vector<double>>());
+        });
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_pull_vector);
+
+    void table_pull_vector_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        lua_createtable(lua, elements, 0);
+        for (int i = 0; i < elements; ++i)
+        {
+            lua_pushnumber(lua, i * .5);
+            lua_rawseti(lua, -2, i + 1);
+        }
+        for (auto _ : state)
+        {
+            const auto size = static_cast<int>(lua_objlen(lua, -1));
+            std::vector<double> values;
+            values.reserve(static_cast<std::size_t>(size));
+            for (int i = 1; i <= size; ++i)
+            {
+                lua_rawgeti(lua, -1, i);
+                values.push_back(luaL_checknumber(lua, -1));
+                lua_pop(lua, 1);
+            }
+            benchmark::DoNotOptimize(values);
+        }
+        state.SetItemsProcessed(state.iterations() * elements);
+    }
+    BENCHMARK(table_pull_vector_raw);
+}
@@ -0,0 +1,200 @@
+#include "raw.hpp"
+
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <new>
+#include <string_view>
+
+namespace
+{
+    constexpr int accessesPerIteration = 1000;
+
+    struct Vector
+    {
+        double mX;
+        double mY;
+        double mZ;
+    };
+
+    constexpr const char* rawVectorMetatable = "Vector";
+
+    void pushRawVector(lua_State* state, const Vector& value)
+    {
+        new (lua_newuserdata(state, sizeof(Vector))) Vector(value);
+        luaL_getmetatable(state, rawVectorMetatable);
+        lua_setmetatable(state, -2);
+    }
+
+    void userdata_push_and_get(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            for (auto _ : state)
+            {
+                lat::ObjectView view = stack.push(Vector{ 1., 2., 3. });
+                benchmark::DoNotOptimize(view.as<const Vector&>().mX);
+                stack.pop();
+            }
+        });
+    }
+    BENCHMARK(userdata_push_and_get);
+
+    void userdata_push_and_get_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        luaL_newmetatable(lua, rawVectorMetatable);
+        lua_pop(lua, 1);
+        for (auto _ : state)
+        {
+            pushRawVector(lua, Vector{ 1., 2., 3. });
+            benchmark::DoNotOptimize(static_cast<const Vector*>(luaL_checkudata(lua, -1, rawVectorMetatable))->mX);
+            lua_pop(lua, 1);
+        }
+    }
+    BENCHMARK(userdata_push_and_get_raw);
+
+    void userdata_get(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::ObjectView view = stack.push(Vector{ 1., 2., 3. });
+            for (auto _ : state)
+                benchmark::DoNotOptimize(view.as<const Vector&>().mX);
+        });
+    }
+    BENCHMARK(userdata_get);
+
+    void userdata_get_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        luaL_newmetatable(lua, rawVectorMetatable);
+        lua_pop(lua, 1);
+        pushRawVector(lua, Vector{ 1., 2., 3. });
+        for (auto _ : state)
+            benchmark::DoNotOptimize(static_cast<const Vector*>(luaL_checkudata(lua, -1, rawVectorMetatable))->mX);
+    }
+    BENCHMARK(userdata_get_raw);
+
+    void userdata_matches(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            lat::ObjectView view = stack.push(Vector{ 1., 2., 3. });
+            for (auto _ : state)
+                benchmark::DoNotOptimize(view.is<Vector>());
+        });
+    }
+    BENCHMARK(userdata_matches);
+
+    struct Entity
+    {
+        int mId;
+    };
+
+    struct Actor : Entity
+    {
+    };
+
+    struct Creature : Actor
+    {
+    };
+
+    struct Npc : Creature
+    {
+    };
+
+    void userdata_get_base(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            stack.newUserType<Npc, Creature>("Npc");
+            stack.newUserType<Creature, Actor>("Creature");
+            stack.newUserType<Actor, Entity>("Actor");
+            lat::ObjectView view = stack.push(Npc{});
+            for (auto _ : state)
+                benchmark::DoNotOptimize(view.as<const Entity&>().mId);
+        });
+    }
+    BENCHMARK(userdata_get_base);
+
+    constexpr std::string_view propertyLoop = "local v = v for i = 1, ... do v.x = v.x + 1 end";
+
+    void usertype_property_get_set(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.withStack([&](lat::Stack& stack) {
+            auto type = stack.newUserType<Vector>("Vector");
+            type.setProperty(
+                "x", [](const Vector& v) { return v.mX; }, [](Vector& v, double x) { v.mX = x; });
+            stack["v"] = Vector{};
+            auto loop = stack.pushFunction(propertyLoop);
+            for (auto _ : state)
+                loop(accessesPerIteration);
+        });
+        state.SetItemsProcessed(state.iterations() * accessesPerIteration);
+    }
+    BENCHMARK(usertype_property_get_set);
+
+    void usertype_ffi_field_get_set(benchmark::State& state)
+    {
+        lat::State lua;
+        lua.loadLibraries({ { lat::Library::JIT, lat::Library::FFI } });
+        lua.withStack([&](lat::Stack& stack) {
+            auto type = stack.newUserType<Vector>("Vector");
+            type.setProperty(
+                "x", [](const Vector& v) { return v.mX; }, [](Vector& v, double x) { v.mX = x; });
+            type.setFfiFields<Vector>({ { "x", &Vector::mX }, { "y", &Vector::mY }, { "z", &Vector::mZ } });
+            stack["v"] = Vector{};
+            auto loop = stack.pushFunction(propertyLoop);
+            for (auto _ : state)
+                loop(accessesPerIteration);
+        });
+        state.SetItemsProcessed(state.iterations() * accessesPerIteration);
+    }
+    BENCHMARK(usertype_ffi_field_get_set);
+
+    int rawIndex(lua_State* state)
+    {
+        auto* v = static_cast<Vector*>(luaL_checkudata(state, 1, rawVectorMetatable));
+        if (std::strcmp(luaL_checkstring(state, 2), "x") != 0)
+            return 0;
+        lua_pushnumber(state, v->mX);
+        return 1;
+    }
+
+    int rawNewIndex(lua_State* state)
+    {
+        auto* v = static_cast<Vector*>(luaL_checkudata(state, 1, rawVectorMetatable));
+        if (std::strcmp(luaL_checkstring(state, 2), "x") != 0)
+            return luaL_error(state, "unknown property");
+        v->mX = luaL_checknumber(state, 3);
+        return 0;
+    }
+
+    void usertype_property_get_set_raw(benchmark::State& state)
+    {
+        raw::State lua;
+        luaL_newmetatable(lua, rawVectorMetatable);
+        lua_pushcfunction(lua, &rawIndex);
+        lua_setfield(lua, -2, "__index");
+        lua_pushcfunction(lua, &rawNewIndex);
+        lua_setfield(lua, -2, "__newindex");
+        lua_pop(lua, 1);
+        pushRawVector(lua, Vector{});
+        lua_setglobal(lua, "v");
+        lua.load(propertyLoop);
+        const int loop = lua_gettop(lua);
+        for (auto _ : state)
+        {
+            lua_pushvalue(lua, loop);
+            lua_pushinteger(lua, accessesPerIteration);
+            lua.call(1, 0);
+        }
+        state.SetItemsProcessed(state.iterations() * accessesPerIteration);
+    }
+    BENCHMARK(usertype_property_get_set_raw);
+}
@@ -0,0 +1,104 @@
+#include "arenaallocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace lat
+{
+    namespace
+    {
+        constexpr std::size_t alignUp(std::size_t size)
+        {
+            return (size + ArenaAllocator::alignment - 1) & ~(ArenaAllocator::alignment - 1);
+        }
+    }
+
+    ArenaAllocator::ArenaAllocator(std::size_t limit, std::size_t chunkSize)
+        : mLimit(limit)
+        , mChunkSize(alignUp(std::max<std::size_t>(chunkSize, 1)))
+    {
+    }
+
+    void* ArenaAllocator::bump(std::size_t size)
+    {
+        size = alignUp(size);
+        if (static_cast<std::size_t>(mEnd - mNext) < size)
+        {
+            // Oversized blocks get a chunk of their own, and near the limit a chunk only as large as the block
+            std::size_t chunkSize = std::max(size, mChunkSize);
+            if (mLimit - mReserved < chunkSize)
+                chunkSize = size;
+            if (mLimit - mReserved < chunkSize)
+            {
+                ++mRefused;
+                return nullptr;
+            }
+            std::unique_ptr<std::byte[]> chunk(new (std::nothrow) std::byte[chunkSize]);
+            if (!chunk)
+                return nullptr;
+            try
+            {
+                mChunks.push_back(std::move(chunk));
+            }
+            catch (const std::bad_alloc&)
+            {
+                return nullptr;
+            }
+            if (mChunks.size() == 1)
+                mFirstChunkSize = chunkSize;
+            mReserved += chunkSize;
+            mNext = mChunks.back().get();
+            mEnd = mNext + chunkSize;
+        }
+        mLast = mNext;
+        mNext += size;
+        mUsed += size;
+        return mLast;
+    }
+
+    void* ArenaAllocator::reallocate(void* pointer, std::size_t oldSize, std::size_t newSize)
+    {
+        if (pointer == nullptr)
+            return newSize == 0 ? nullptr : bump(newSize);
+        const bool last = pointer == mLast;
+        if (newSize == 0)
+        {
+            if (last)
+            {
+                mUsed -= static_cast<std::size_t>(mNext - mLast);
+                mNext = mLast;
+                mLast = nullptr;
+            }
+            return nullptr;
+        }
+        if (newSize <= oldSize && !last)
+            return pointer;
+        if (last && static_cast<std::size_t>(mEnd - mLast) >= alignUp(newSize))
+        {
+            std::byte* next = mLast + alignUp(newSize);
+            mUsed = mUsed - static_cast<std::size_t>(mNext - mLast) + alignUp(newSize);
+            mNext = next;
+            return pointer;
+        }
+        void* moved = bump(newSize);
+        if (moved != nullptr)
+            std::memcpy(moved, pointer, std::min(oldSize, newSize));
+        return moved;
+    }
+
+    void ArenaAllocator::reset()
+    {
+        mChunks.resize(std::min<std::size_t>(mChunks.size(), 1));
+        mReserved = mChunks.empty() ? 0 : mFirstChunkSize;
+        mNext = mChunks.empty() ? nullptr : mChunks.front().get();
+        mEnd = mNext + mReserved;
+        mLast = nullptr;
+        mUsed = 0;
+    }
+
+    ArenaAllocatorStats ArenaAllocator::getStats() const
+    {
+        return { .mUsed = mUsed, .mReserved = mReserved, .mChunkCount = mChunks.size(), .mRefused = mRefused };
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef LATTICE_ARENAALLOCATOR_H
+#define LATTICE_ARENAALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace lat
+{
+    struct ArenaAllocatorStats
+    {
+        // Bytes currently occupied by the bump region; only the most recent block can be given back
+        std::size_t mUsed;
+        // Bytes taken from the system
+        std::size_t mReserved;
+        std::size_t mChunkCount;
+        // Allocations refused because of the limit
+        std::size_t mRefused;
+    };
+
+    // Bump allocator for states that run briefly and are then thrown away. Blocks are never freed on their own: only
+    // the most recent block can grow, shrink or be freed in place. Everything else is released at once by reset or
+    // the destructor, leaving lua_close with nothing to do for each object besides running finalizers.
+    //     ArenaAllocator arena(1024 * 1024);
+    //     State state(&ArenaAllocator::allocate, &arena);
+    // An allocation that would take the arena's reserved memory past its limit fails, which the state reports as a
+    // memory error. The arena must outlive its state and only be used by one thread at a time.
+    class ArenaAllocator
+    {
+    public:
+        static constexpr std::size_t noLimit = std::numeric_limits<std::size_t>::max();
+        static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    private:
+        std::vector<std::unique_ptr<std::byte[]>> mChunks;
+        std::byte* mNext = nullptr;
+        std::byte* mEnd = nullptr;
+        // Start of the most recent block, if it has not been freed
+        std::byte* mLast = nullptr;
+        std::size_t mFirstChunkSize = 0;
+        std::size_t mLimit;
+        std::size_t mChunkSize;
+        std::size_t mUsed = 0;
+        std::size_t mReserved = 0;
+        std::size_t mRefused = 0;
+
+        ArenaAllocator(const ArenaAllocator&) = delete;
+
+        void* bump(std::size_t size);
+        void* reallocate(void* pointer, std::size_t oldSize, std::size_t newSize);
+
+    public:
+        explicit ArenaAllocator(std::size_t limit = noLimit, std::size_t chunkSize = 64 * 1024);
+
+        // Matches Allocator<ArenaAllocator>
+        static void* allocate(ArenaAllocator* arena, void* pointer, std::size_t oldSize, std::size_t newSize)
+        {
+            return arena->reallocate(pointer, oldSize, newSize);
+        }
+
+        // Makes the memory available again, keeping the first chunk. Only valid once the state using the arena has
+        // been destroyed.
+        void reset();
+
+        std::size_t getLimit() const { return mLimit; }
+        ArenaAllocatorStats getStats() const;
+    };
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "callqueue.hpp"
+
+#include <memory>
+#include <utility>
+
+namespace lat
+{
+    CallQueue::~CallQueue()
+    {
+        for (Node* node : { mPosted.exchange(nullptr), mPending })
+        {
+            while (node != nullptr)
+                delete std::exchange(node, node->mNext);
+        }
+    }
+
+    void CallQueue::post(std::function<void(Stack&)> call)
+    {
+        Node* node = new Node{ std::move(call), mPosted.load(std::memory_order_relaxed) };
+        while (!mPosted.compare_exchange_weak(node->mNext, node, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void CallQueue::takePosted()
+    {
+        Node* newest = mPosted.exchange(nullptr, std::memory_order_acquire);
+        Node* oldest = nullptr;
+        for (Node* node = newest; node != nullptr;)
+        {
+            Node* next = node->mNext;
+            node->mNext = oldest;
+            oldest = node;
+            node = next;
+        }
+        if (oldest != nullptr)
+        {
+            if (mPendingTail != nullptr)
+                mPendingTail->mNext = oldest;
+            else
+                mPending = oldest;
+            mPendingTail = newest;
+        }
+    }
+
+    std::unique_ptr<CallQueue::Node> CallQueue::takePending()
+    {
+        std::unique_ptr<Node> node(mPending);
+        mPending = node->mNext;
+        if (mPending == nullptr)
+            mPendingTail = nullptr;
+        return node;
+    }
+
+    std::size_t CallQueue::drain(Stack& stack)
+    {
+        if (!mErrors.empty())
+        {
+            std::exception_ptr error = std::move(mErrors.front());
+            mErrors.pop_front();
+            std::rethrow_exception(error);
+        }
+        takePosted();
+        std::size_t count = 0;
+        while (mPending != nullptr)
+        {
+            std::unique_ptr<Node> node = takePending();
+            ++count;
+            node->mCall(stack);
+        }
+        return count;
+    }
+
+    std::size_t CallQueue::drainFromHook(Stack& stack)
+    {
+        takePosted();
+        std::size_t count = 0;
+        while (mPending != nullptr)
+        {
+            std::unique_ptr<Node> node = takePending();
+            ++count;
+            try
+            {
+                node->mCall(stack);
+            }
+            catch (const std::exception& e)
+            {
+                if (mErrorHandler)
+                    mErrorHandler(e.what());
+                else
+                    mErrors.push_back(std::current_exception());
+            }
+            catch (...)
+            {
+                if (mErrorHandler)
+                    mErrorHandler("unknown error");
+                else
+                    mErrors.push_back(std::current_exception());
+            }
+        }
+        return count;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef LATTICE_CALLQUEUE_H
+#define LATTICE_CALLQUEUE_H
+
+#include "stack.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace lat
+{
+    // Calls posted from any thread and run by the thread owning the State, see State::getCallQueue
+    class CallQueue
+    {
+        struct Node
+        {
+            std::function<void(Stack&)> mCall;
+            Node* mNext;
+        };
+
+        // Lock-free stack of posted calls, newest first
+        std::atomic<Node*> mPosted = nullptr;
+        // Only touched by the draining thread, oldest first
+        Node* mPending = nullptr;
+        Node* mPendingTail = nullptr;
+        // Errors of calls run from the debug hook, waiting to be rethrown by drain
+        std::deque<std::exception_ptr> mErrors;
+        std::function<void(std::string_view)> mErrorHandler;
+
+        CallQueue(const CallQueue&) = delete;
+
+        // Moves the posted calls to the end of the pending ones
+        void takePosted();
+        std::unique_ptr<Node> takePending();
+
+    public:
+        CallQueue() = default;
+        ~CallQueue();
+
+        // Thread-safe
+        void post(std::function<void(Stack&)> call);
+
+        // Thread-safe. Copies the arguments and calls the global function name with them.
+        template <class... Args>
+        void postCall(std::string name, Args&&... args)
+        {
+            static_assert(!(false || ... || std::is_base_of_v<ObjectViewBase, std::remove_cvref_t<Args>>),
+                "views cannot leave the thread owning their state");
+            post([name = std::move(name), values = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...)](
+                     Stack& stack) {
+                FunctionView function = stack[name.c_str()];
+                try
+                {
+                    std::apply([&](const auto&... v) { function(v...); }, values);
+                }
+                catch (...)
+                {
+                    stack.pop();
+                    throw;
+                }
+                stack.pop();
+            });
+        }
+
+        // Owning thread only. Runs the calls posted before draining started, in the order they were posted. If a call
+        // throws, the calls after it stay queued. Returns the number of calls run.
+        // An error kept by drainFromHook is rethrown first, before running any calls.
+        std::size_t drain(Stack&);
+
+        // Owning thread only. Like drain, but the script the hook interrupted has nothing to do with the calls, so their
+        // errors must not end up in it. A call that throws is skipped and its error is passed to the error handler, or
+        // kept for the next drain without one.
+        std::size_t drainFromHook(Stack&);
+
+        // Owning thread only. Called with the error of a call run from the debug hook.
+        void setErrorHandler(std::function<void(std::string_view)> handler) { mErrorHandler = std::move(handler); }
+    };
+}
+
+#endif
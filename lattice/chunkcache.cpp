@@ -0,0 +1,72 @@
+#include "chunkcache.hpp"
+
+#include "state.hpp"
+
+#include <functional>
+
+namespace lat
+{
+    std::size_t ChunkCache::KeyHash::operator()(const Key& key) const noexcept
+    {
+        const std::hash<std::string_view> hash;
+        const std::size_t name = hash(key.mName);
+        return hash(key.mSource) ^ (name + 0x9e3779b9 + (name << 6) + (name >> 2));
+    }
+
+    const std::string* ChunkCache::find(std::string_view source, std::string_view name)
+    {
+        const auto found = mIndex.find(Key{ source, name });
+        if (found == mIndex.end())
+        {
+            ++mMisses;
+            return nullptr;
+        }
+        ++mHits;
+        mEntries.splice(mEntries.begin(), mEntries, found->second);
+        return &found->second->mByteCode;
+    }
+
+    void ChunkCache::insert(std::string_view source, std::string_view name, std::string&& byteCode)
+    {
+        if (mCapacity == 0 || mIndex.contains(Key{ source, name }))
+            return;
+        shrink(mCapacity - 1);
+        Entry& entry = mEntries.emplace_front(std::string(source), std::string(name), std::move(byteCode));
+        try
+        {
+            mIndex.emplace(Key{ entry.mSource, entry.mName }, mEntries.begin());
+        }
+        catch (...)
+        {
+            mEntries.pop_front();
+            throw;
+        }
+    }
+
+    void ChunkCache::shrink(std::size_t size)
+    {
+        while (mEntries.size() > size)
+        {
+            const Entry& entry = mEntries.back();
+            mIndex.erase(Key{ entry.mSource, entry.mName });
+            mEntries.pop_back();
+        }
+    }
+
+    void ChunkCache::setCapacity(std::size_t capacity)
+    {
+        mCapacity = capacity;
+        shrink(capacity);
+    }
+
+    void ChunkCache::clear()
+    {
+        mIndex.clear();
+        mEntries.clear();
+    }
+
+    ChunkCacheStats ChunkCache::getStats() const
+    {
+        return { mHits, mMisses, mEntries.size(), mCapacity };
+    }
+}
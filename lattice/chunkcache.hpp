@@ -0,0 +1,60 @@
+#ifndef LATTICE_CHUNKCACHE_H
+#define LATTICE_CHUNKCACHE_H
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace lat
+{
+    struct ChunkCacheStats;
+
+    // Least recently used cache of bytecode compiled from source, keyed by source and chunk name
+    class ChunkCache
+    {
+        struct Entry
+        {
+            std::string mSource;
+            std::string mName;
+            std::string mByteCode;
+        };
+
+        struct Key
+        {
+            std::string_view mSource;
+            std::string_view mName;
+
+            bool operator==(const Key&) const = default;
+        };
+
+        struct KeyHash
+        {
+            std::size_t operator()(const Key&) const noexcept;
+        };
+
+        // Most recently used first
+        std::list<Entry> mEntries;
+        // Keys view the strings owned by mEntries
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> mIndex;
+        std::size_t mCapacity = 0;
+        std::size_t mHits = 0;
+        std::size_t mMisses = 0;
+
+        void shrink(std::size_t);
+
+    public:
+        bool isEnabled() const { return mCapacity > 0; }
+
+        const std::string* find(std::string_view source, std::string_view name);
+        void insert(std::string_view source, std::string_view name, std::string&& byteCode);
+
+        void setCapacity(std::size_t);
+        void clear();
+
+        ChunkCacheStats getStats() const;
+    };
+}
+
+#endif
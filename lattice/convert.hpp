@@ -6,12 +6,16 @@
 #include "state.hpp"
 #include "userdata.hpp"
 
+#include <array>
 #include <concepts>
 #include <cstddef>
+#include <map>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string_view>
 #include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -54,6 +58,28 @@ namespace lat
         template <class T>
         concept Variant = isVariant<T>;
 
+        template <class>
+        constexpr inline bool isVector = false;
+        template <class T, class Allocator>
+        constexpr inline bool isVector<std::vector<T, Allocator>> = true;
+
+        template <class>
+        constexpr inline bool isStdArray = false;
+        template <class T, std::size_t N>
+        constexpr inline bool isStdArray<std::array<T, N>> = true;
+
+        template <class>
+        constexpr inline bool isSpan = false;
+        template <class T, std::size_t N>
+        constexpr inline bool isSpan<std::span<T, N>> = true;
+
+        template <class>
+        constexpr inline bool isMap = false;
+        template <class K, class V, class Compare, class Allocator>
+        constexpr inline bool isMap<std::map<K, V, Compare, Allocator>> = true;
+        template <class K, class V, class Hash, class Equal, class Allocator>
+        constexpr inline bool isMap<std::unordered_map<K, V, Hash, Equal, Allocator>> = true;
+
         template <class T>
         concept ReferenceWrapper = !std::is_same_v<T, std::unwrap_reference_t<T>>;
 
@@ -66,6 +92,14 @@ namespace lat
         template <class T>
         concept String = std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>;
 
+        // Containers converted to and from tables; character arrays are strings
+        template <class T>
+        concept ArrayContainer
+            = isVector<T> || isStdArray<T> || isSpan<T> || (std::is_array_v<T> && !StringViewConstructible<T>);
+
+        template <class T>
+        concept MapContainer = isMap<T>;
+
         template <class Value, class T = std::remove_cvref_t<Value>>
         inline Value pullFromStack(Stack&, int&);
         template <class Value, class T = std::remove_cvref_t<Value>>
@@ -192,20 +226,14 @@ namespace lat
                 return {};
             else if (stack.isNil(pos))
             {
-                stack.remove(pos);
+                ++pos;
                 return {};
             }
             const int initial = pos;
             using OptT = typename T::value_type;
+            // Values that don't match are skipped over
             if (!stackValueIs<OptT>(stack, pos))
-            {
-                while (pos > initial)
-                {
-                    stack.remove(initial);
-                    --pos;
-                }
                 return {};
-            }
             pos = initial;
             return pullFromStack<OptT>(stack, pos);
         }
@@ -260,6 +288,29 @@ namespace lat
         template <class T>
         concept SingleStackPull = pullsOneValue<T> || !PullSpecialized<T>;
 
+        // Pulling never removes values from the stack. Types that keep referring to their stack slots (views)
+        // require the caller to leave those slots in place; everything else can be popped once pulled.
+        template <class T>
+        constexpr inline bool keepsStackValue = PullSpecialized<T>;
+        template <Optional T>
+        constexpr inline bool keepsStackValue<T> = keepsStackValue<typename T::value_type>;
+        template <class... Types>
+        constexpr inline bool keepsStackValue<std::variant<Types...>> = (false || ... || keepsStackValue<Types>);
+
+        // Pulls a value, raising keep to the last stack slot that needs to stay
+        template <class Value, class T = std::remove_cvref_t<Value>>
+        inline Value pullFromStack(Stack& stack, int& pos, int& keep)
+        {
+            if constexpr (keepsStackValue<T>)
+            {
+                Value value = pullFromStack<Value>(stack, pos);
+                keep = pos - 1;
+                return value;
+            }
+            else
+                return pullFromStack<Value>(stack, pos);
+        }
+
         template <class Value, bool light = false, class T = std::remove_cvref_t<Value>,
             class V = std::remove_volatile_t<Value>>
         inline void pushToStack(Stack& stack, Value&& value)
@@ -307,8 +358,6 @@ namespace lat
                 using RefT = typename T::type;
                 pushToStack<RefT&, true>(stack, value.get());
             }
-            else if constexpr (std::is_array_v<T>)
-                static_assert(false, "array types are not supported");
             else if constexpr (Function<T>)
                 stack.pushFunction(std::forward<V>(value));
             else if constexpr (std::is_pointer_v<T>)
@@ -366,15 +415,11 @@ namespace lat
             }
             else if constexpr (GetFromViewSpecialized<T>)
             {
-                T value = getValue(stack.getObject(pos), Type<T>{});
-                stack.remove(pos);
-                return value;
+                return getValue(stack.getObject(pos++), Type<T>{});
             }
             else
             {
-                Value value = stack.getObject(pos).as<Value>();
-                stack.remove(pos);
-                return value;
+                return stack.getObject(pos++).as<Value>();
             }
         }
     }
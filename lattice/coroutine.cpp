@@ -0,0 +1,69 @@
+#include "coroutine.hpp"
+
+#include "lua/api.hpp"
+#include "reference.hpp"
+#include "state.hpp"
+
+#include <stdexcept>
+
+namespace lat
+{
+    CoroutineStatus Coroutine::getStatus() const
+    {
+        LuaApi thread(*mStack.api().asThread(mIndex));
+        switch (thread.status())
+        {
+            case LuaStatus::Yield:
+                return CoroutineStatus::Yielded;
+            case LuaStatus::Ok:
+                // Resuming consumes the body function and every result is moved off the thread
+                if (thread.getStackSize() == 0)
+                    return CoroutineStatus::Finished;
+                return CoroutineStatus::Suspended;
+            default:
+                return CoroutineStatus::Errored;
+        }
+    }
+
+    bool Coroutine::isResumable() const
+    {
+        const CoroutineStatus status = getStatus();
+        return status == CoroutineStatus::Suspended || status == CoroutineStatus::Yielded;
+    }
+
+    void Coroutine::resume(int prev, int resCount) const
+    {
+        const int argCount = mStack.getTop() - prev;
+        if (argCount < 0)
+            throw std::runtime_error("expected a positive argument count");
+        switch (getStatus())
+        {
+            case CoroutineStatus::Finished:
+                throw std::runtime_error("cannot resume a finished coroutine");
+            case CoroutineStatus::Errored:
+                throw std::runtime_error("cannot resume a failed coroutine");
+            default:
+                break;
+        }
+        mStack.resumeCoroutine(mIndex, argCount);
+        if (resCount >= 0)
+            mStack.api().setStackSize(prev + resCount);
+    }
+
+    bool Coroutine::recycle() const
+    {
+        if (getStatus() != CoroutineStatus::Finished)
+            return false;
+        return mStack.recycleCoroutine(mIndex);
+    }
+
+    CoroutineReference Coroutine::store() const
+    {
+        return CoroutineReference(ObjectView(*this).store());
+    }
+
+    void Coroutine::setMemoryOwner(MemoryOwner owner) const
+    {
+        State::setThreadOwner(mStack, mIndex, owner);
+    }
+}
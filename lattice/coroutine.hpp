@@ -0,0 +1,92 @@
+#ifndef LATTICE_COROUTINE_H
+#define LATTICE_COROUTINE_H
+
+#include "convert.hpp"
+#include "forwardstack.hpp"
+#include "function.hpp"
+#include "object.hpp"
+
+namespace lat
+{
+    class CoroutineReference;
+
+    enum class CoroutineStatus
+    {
+        // Created but not resumed yet
+        Suspended,
+        Yielded,
+        Finished,
+        Errored,
+    };
+
+    // A Lua thread resumed directly through lua_resume. Arguments and results are moved between the thread and the
+    // stack the view lives on.
+    class Coroutine : public ObjectViewBase
+    {
+        Coroutine(Stack& stack, int index)
+            : ObjectViewBase(stack, index)
+        {
+        }
+
+        void resume(int prev, int resCount) const;
+
+        friend class ObjectView;
+        friend class Stack;
+
+    public:
+        CoroutineStatus getStatus() const;
+        bool isResumable() const;
+
+        // Returns the values passed to coroutine.yield or returned by the body function
+        template <class Ret = void, class... Args>
+        Ret resume(Args&&... args) const
+        {
+            const int top = mStack.getTop();
+            try
+            {
+                (detail::pushToStack(mStack, std::forward<Args>(args)), ...);
+                resume(top, detail::resultCount<Ret>);
+                if constexpr (!std::is_void_v<Ret>)
+                    return detail::pullResults<Ret>(mStack, top + 1);
+            }
+            catch (...)
+            {
+                detail::popTo(mStack, top);
+                throw;
+            }
+        }
+
+        CoroutineReference store() const;
+
+        // Charges the allocations made while the coroutine is resumed from C++ to owner, regardless of the owner set
+        // by the caller. Resuming it from Lua keeps the caller's owner.
+        void setMemoryOwner(MemoryOwner owner) const;
+
+        // Hands a finished thread to the state's coroutine pool for reuse by Stack::pushCoroutine. Returns false if the
+        // coroutine has not finished or the pool is disabled or full. A recycled thread must no longer be used.
+        bool recycle() const;
+    };
+
+    inline Coroutine pullValue(Stack& stack, int& pos, Type<Coroutine>)
+    {
+        return stack.getObject(pos++).asCoroutine();
+    }
+
+    inline bool isValue(const Stack& stack, int& pos, Type<Coroutine>)
+    {
+        return stack.isCoroutine(pos++);
+    }
+
+    inline Coroutine getValue(ObjectView view, Type<Coroutine>)
+    {
+        return view.asCoroutine();
+    }
+
+    namespace detail
+    {
+        template <>
+        constexpr inline bool pullsOneValue<Coroutine> = true;
+    }
+}
+
+#endif
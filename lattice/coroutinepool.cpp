@@ -0,0 +1,45 @@
+#include "coroutinepool.hpp"
+
+#include "object.hpp"
+#include "state.hpp"
+
+#include <utility>
+
+namespace lat
+{
+    bool CoroutinePool::pop(Stack& stack)
+    {
+        if (mThreads.empty())
+        {
+            ++mCreated;
+            return false;
+        }
+        mThreads.back().pushTo(stack);
+        mThreads.pop_back();
+        ++mReused;
+        return true;
+    }
+
+    void CoroutinePool::push(Reference&& thread)
+    {
+        if (!isFull())
+            mThreads.push_back(std::move(thread));
+    }
+
+    void CoroutinePool::setCapacity(std::size_t capacity)
+    {
+        mCapacity = capacity;
+        if (mThreads.size() > capacity)
+            mThreads.resize(capacity);
+    }
+
+    void CoroutinePool::clear()
+    {
+        mThreads.clear();
+    }
+
+    CoroutinePoolStats CoroutinePool::getStats() const
+    {
+        return { mReused, mCreated, mThreads.size(), mCapacity };
+    }
+}
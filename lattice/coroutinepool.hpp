@@ -0,0 +1,36 @@
+#ifndef LATTICE_COROUTINEPOOL_H
+#define LATTICE_COROUTINEPOOL_H
+
+#include "reference.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace lat
+{
+    struct CoroutinePoolStats;
+
+    // Finished threads kept alive through registry references so Stack::pushCoroutine can reuse them
+    class CoroutinePool
+    {
+        std::vector<Reference> mThreads;
+        std::size_t mCapacity = 0;
+        std::size_t mReused = 0;
+        std::size_t mCreated = 0;
+
+    public:
+        bool isEnabled() const { return mCapacity > 0; }
+        bool isFull() const { return mThreads.size() >= mCapacity; }
+
+        // Pushes a pooled thread, returning false if the caller has to create one
+        bool pop(Stack&);
+        void push(Reference&& thread);
+
+        void setCapacity(std::size_t);
+        void clear();
+
+        CoroutinePoolStats getStats() const;
+    };
+}
+
+#endif
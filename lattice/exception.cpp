@@ -16,4 +16,9 @@ namespace lat
         , mIndex(index)
     {
     }
+
+    MemoryError::MemoryError(const char* message)
+        : std::runtime_error(message)
+    {
+    }
 }
@@ -32,6 +32,15 @@ namespace lat
 
         int getIndex() const noexcept { return mIndex; }
     };
+
+    // Lua ran out of memory, including when a State's hard memory limit was reached
+    class MemoryError : public std::runtime_error
+    {
+    public:
+        explicit MemoryError(const char* message);
+
+        MemoryError(const MemoryError&) noexcept = default;
+    };
 }
 
 #endif
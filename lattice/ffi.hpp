@@ -0,0 +1,173 @@
+#ifndef LATTICE_FFI_H
+#define LATTICE_FFI_H
+
+#include "forwardstack.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace lat
+{
+    namespace detail
+    {
+        template <class T>
+        concept FfiValue = std::is_arithmetic_v<T> && !std::is_same_v<T, long double>;
+
+        // 64-bit integers cross as doubles so they reach Lua as numbers, like they do through other bindings, instead
+        // of boxed int64 cdata
+        template <class T>
+        struct FfiAbi
+        {
+            using type = T;
+        };
+
+        template <class T>
+            requires(std::is_integral_v<T> && sizeof(T) == 8)
+        struct FfiAbi<T>
+        {
+            using type = double;
+        };
+
+        template <class T>
+        using FfiAbiType = typename FfiAbi<T>::type;
+
+        template <class T>
+        constexpr std::string_view ffiTypeName()
+        {
+            if constexpr (std::is_void_v<T>)
+                return "void";
+            else if constexpr (std::is_same_v<T, bool>)
+                return "bool";
+            else if constexpr (std::is_same_v<T, float>)
+                return "float";
+            else if constexpr (std::is_same_v<T, double>)
+                return "double";
+            else if constexpr (sizeof(T) == 1)
+                return std::is_signed_v<T> ? "int8_t" : "uint8_t";
+            else if constexpr (sizeof(T) == 2)
+                return std::is_signed_v<T> ? "int16_t" : "uint16_t";
+            else if constexpr (sizeof(T) == 4)
+                return std::is_signed_v<T> ? "int32_t" : "uint32_t";
+            else
+            {
+                static_assert(sizeof(T) == 8);
+                return std::is_signed_v<T> ? "int64_t" : "uint64_t";
+            }
+        }
+
+        // Only the member's address is taken, so no object needs to be constructed
+        template <class T, class M>
+        std::size_t memberOffset(M T::*member)
+        {
+            alignas(T) std::byte storage[sizeof(T)];
+            const T* object = reinterpret_cast<const T*>(storage);
+            return static_cast<std::size_t>(reinterpret_cast<const std::byte*>(&(object->*member)) - storage);
+        }
+
+        struct FfiFieldInfo
+        {
+            std::string_view mName;
+            std::string_view mType;
+            std::size_t mOffset;
+            std::size_t mSize;
+            // Elements of an array member, 0 for scalars
+            std::size_t mCount;
+        };
+
+        template <class>
+        struct FfiSignature
+        {
+            static constexpr bool valid = false;
+        };
+
+        template <class R, class... Args>
+        struct FfiSignature<R (*)(Args...)>
+        {
+            static constexpr bool valid = (std::is_void_v<R> || FfiValue<R>) && (true && ... && FfiValue<Args>);
+
+            // The C declaration of a pointer to invoke
+            static std::string getType()
+            {
+                std::string type(ffiTypeName<FfiAbiType<R>>());
+                type += " (*)(";
+                if constexpr (sizeof...(Args) == 0)
+                    type += "void";
+                [[maybe_unused]] std::size_t i = 0;
+                ((type += i++ > 0 ? ", " : "", type += ffiTypeName<FfiAbiType<Args>>()), ...);
+                type += ')';
+                return type;
+            }
+
+            // A C-compatible shim; exceptions cannot unwind through compiled traces, so they terminate
+            template <auto Function>
+            static FfiAbiType<R> invoke(FfiAbiType<Args>... args) noexcept
+            {
+                if constexpr (std::is_void_v<R>)
+                    Function(static_cast<Args>(args)...);
+                else
+                    return static_cast<FfiAbiType<R>>(Function(static_cast<Args>(args)...));
+            }
+        };
+
+        template <class R, class... Args>
+        struct FfiSignature<R (*)(Args...) noexcept> : FfiSignature<R (*)(Args...)>
+        {
+        };
+    }
+
+    template <auto Function>
+    struct FfiBound
+    {
+        using Signature = detail::FfiSignature<std::remove_const_t<decltype(Function)>>;
+        static_assert(
+            Signature::valid, "only functions taking and returning arithmetic types can be bound through the FFI");
+
+        static constexpr auto function = Function;
+    };
+
+    // Binds a function with arithmetic parameters and result as an FFI function pointer when LuaJIT's FFI library is
+    // loaded, so compiled traces call it directly instead of leaving the trace. Without it, this is the same as bind.
+    // The function must not throw. Integer arguments are truncated rather than checked.
+    template <auto Function>
+    constexpr inline FfiBound<Function> bindFfi{};
+
+    namespace detail
+    {
+        template <class>
+        constexpr inline bool isFfiBound = false;
+        template <auto Function>
+        constexpr inline bool isFfiBound<FfiBound<Function>> = true;
+    }
+
+    // An arithmetic data member, or an array of them, of a struct exposed through UserType::setFfiFields
+    template <class T>
+    class FfiField
+    {
+        detail::FfiFieldInfo mInfo;
+
+    public:
+        template <detail::FfiValue M>
+        FfiField(std::string_view name, M T::*member)
+            : mInfo{ name, detail::ffiTypeName<M>(), detail::memberOffset(member), sizeof(M), 0 }
+        {
+        }
+
+        template <detail::FfiValue M, std::size_t N>
+        FfiField(std::string_view name, M (T::*member)[N])
+            : mInfo{ name, detail::ffiTypeName<M>(), detail::memberOffset(member), sizeof(M) * N, N }
+        {
+        }
+
+        const detail::FfiFieldInfo& getInfo() const { return mInfo; }
+    };
+
+    template <auto Function>
+    inline void pushValue(Stack& stack, FfiBound<Function> function)
+    {
+        stack.pushFunction(function);
+    }
+}
+
+#endif
@@ -2,7 +2,9 @@
 #define LATTICE_FORWARDSTACK_H
 
 #include "functionref.hpp"
+#include "state.hpp"
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <optional>
@@ -14,14 +16,47 @@ struct lua_State;
 namespace lat
 {
     class ByteCode;
+    class Coroutine;
     class FunctionView;
     class LuaApi;
     class ObjectView;
     class Reference;
     class TableView;
+    class Stack;
     class TableLikeViewBase;
     class UserType;
 
+    namespace detail
+    {
+        using FunctionDataDestructor = void (*)(void*);
+
+        // lua_type values, used as bit positions in compile-time argument signatures
+        enum TypeTag : std::uint8_t
+        {
+            NilTag = 0,
+            BooleanTag = 1,
+            LightUserDataTag = 2,
+            NumberTag = 3,
+            StringTag = 4,
+            TableTag = 5,
+            FunctionTag = 6,
+            UserDataTag = 7,
+            ThreadTag = 8,
+            // LuaJIT's FFI data
+            CDataTag = 10,
+        };
+        constexpr inline int typeTagBits = 4;
+        constexpr inline int maxTypeSignatureSize = 64 / typeTagBits;
+
+        // Packs the type tags of the first count stack values, typeTagBits each starting at the lowest bits
+        std::uint64_t getTypeSignature(const Stack&, int count);
+
+        // The inline data of a function pushed by Stack::pushFunctionImpl; only valid inside its lua_CFunction
+        void* getFunctionData(lua_State*);
+        // Converts the exception currently being handled into a Lua error
+        [[noreturn]] void raiseFunctionError(lua_State*);
+    }
+
     // Non-owning lua_State wrapper
     class Stack
     {
@@ -39,18 +74,35 @@ namespace lat
 
         Reference store(int);
 
-        FunctionView pushFunctionImpl(std::function<int(Stack&)>);
-
+        FunctionView pushFunctionImpl(
+            int (*)(lua_State*), std::size_t, detail::FunctionDataDestructor, FunctionRef<void(void*)>);
+        template <auto Invoke, class T>
+        FunctionView pushFunctionImpl(T&&);
+        FunctionView pushFunctionImpl(int (*)(lua_State*));
+        // Pushes LuaJIT's FFI library if it has been loaded, returning false without pushing anything otherwise
+        bool pushFfiLibrary();
+        // Casts the address to an FFI function pointer of the given C type if the FFI library is loaded
+        FunctionView pushFfiFunction(std::string_view type, void* address, int (*fallback)(lua_State*));
+
+        int resumeCoroutine(int index, int argCount);
+        static int callOwnedFunction(lua_State*);
+        bool recycleCoroutine(int index);
+
+        friend class Coroutine;
         friend class FunctionView;
+        friend class JitProfiler;
         friend struct MainStack;
         friend class ObjectView;
         friend class ObjectViewBase;
+        friend class Profiler;
         friend class Reference;
+        friend class Scheduler;
         friend class State;
         friend class TableLikeViewBase;
         friend class TableLikeView;
         friend class TableView;
         friend class UserTypeRegistry;
+        friend std::uint64_t detail::getTypeSignature(const Stack&, int);
 
     public:
         explicit Stack(lua_State*);
@@ -99,6 +151,14 @@ namespace lat
         auto pushFunctionReturning(const ByteCode& code, const char* name = nullptr);
         template <class T>
         FunctionView pushFunction(T&&);
+        template <auto Function>
+        FunctionView pushFunction();
+        // Coroutines pushed while an owner is set, see MemoryOwnerScope, stay charged to it. This covers the tasks of a
+        // Scheduler.
+        Coroutine pushCoroutine(const FunctionView&);
+        // Pushes a function that calls the given one with its allocations charged to owner, for example for the chunk or
+        // the callbacks of a script that C++ calls later. Errors pass through, but the function cannot yield.
+        FunctionView pushOwnedFunction(const FunctionView&, MemoryOwner owner);
         ObjectView pushLightUserData(void*);
         std::span<std::byte> pushUserData(std::size_t);
         template <class T>
@@ -8,11 +8,11 @@
 
 namespace lat
 {
-    void FunctionView::cleanUp(int prev) const
+    void detail::popTo(Stack& stack, int prev)
     {
-        const int diff = mStack.getTop() - prev;
+        const int diff = stack.getTop() - prev;
         if (diff > 0)
-            mStack.pop(static_cast<std::uint16_t>(diff));
+            stack.pop(static_cast<std::uint16_t>(diff));
     }
 
     void FunctionView::call(const int prev, int resCount) const
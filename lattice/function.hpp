@@ -31,6 +31,65 @@ namespace lat
         std::string_view get() const { return mCode; }
     };
 
+    namespace detail
+    {
+        // Pops every value above prev
+        void popTo(Stack&, int prev);
+
+        template <class>
+        constexpr inline bool pullsFixedResults = false;
+        template <class... Types>
+        constexpr inline bool pullsFixedResults<std::tuple<Types...>> = (true && ... && pullsOneValue<Types>);
+
+        // The number of results to request from Lua to produce Ret, -1 for all of them
+        template <class Ret>
+        constexpr inline int resultCount = [] {
+            if constexpr (Tuple<Ret>)
+            {
+                constexpr std::size_t size = std::tuple_size_v<Ret>;
+                if constexpr (pullsFixedResults<Ret>)
+                {
+                    static_assert(size <= std::numeric_limits<int>::max());
+                    return static_cast<int>(size);
+                }
+                else
+                    return -1;
+            }
+            else if constexpr (std::is_void_v<Ret>)
+                return 0;
+            else if constexpr (pullsOneValue<Ret>)
+                return 1;
+            else
+                return -1;
+        }();
+
+        template <class... Types>
+        std::tuple<Types...> pullResults(Stack& stack, int pos, Type<std::tuple<Types...>>)
+        {
+            int keep = pos - 1;
+            // Use braced initializer list to force left-to-right evaluation
+            auto values = std::tuple<Types...>{ pullFromStack<Types>(stack, pos, keep)... };
+            popTo(stack, keep);
+            return values;
+        }
+
+        template <class Ret>
+        Ret pullResults(Stack& stack, int pos, Type<Ret>)
+        {
+            int keep = pos - 1;
+            Ret value = pullFromStack<Ret>(stack, pos, keep);
+            popTo(stack, keep);
+            return value;
+        }
+
+        // Pulls the results starting at pos, leaving only the values views still refer to on the stack
+        template <class Ret>
+        Ret pullResults(Stack& stack, int pos)
+        {
+            return pullResults(stack, pos, Type<Ret>{});
+        }
+    }
+
     class FunctionView : public ObjectViewBase
     {
         FunctionView(Stack& stack, int index)
@@ -38,7 +97,6 @@ namespace lat
         {
         }
 
-        void cleanUp(int prev) const;
         void call(int prev, int resCount) const;
 
         friend class ObjectView;
@@ -46,63 +104,23 @@ namespace lat
         template <class>
         friend class IndexedTableView;
 
-        template <class>
-        constexpr static bool allSpecialized = false;
-
-        template <class... Types>
-        std::tuple<Types...> pullTuple(Type<std::tuple<Types...>>, int pos) const
-        {
-            // Use braced initializer list to force left-to-right evaluation
-            auto values = std::tuple<Types...>{ detail::pullFromStack<Types>(mStack, pos)... };
-            cleanUp(pos - 1);
-            return values;
-        }
-
         template <bool copy, class Ret, class... Args>
         Ret invokeImpl(Args&&... args) const
         {
             const int top = mStack.getTop();
-            constexpr int resCount = [] {
-                if constexpr (detail::Tuple<Ret>)
-                {
-                    constexpr std::size_t size = std::tuple_size_v<Ret>;
-                    if constexpr (allSpecialized<Ret>)
-                    {
-                        static_assert(size <= std::numeric_limits<int>::max());
-                        return static_cast<int>(size);
-                    }
-                    else
-                        return -1;
-                }
-                else if constexpr (std::is_void_v<Ret>)
-                    return 0;
-                else if constexpr (detail::pullsOneValue<Ret>)
-                    return 1;
-                else
-                    return -1;
-            }();
             try
             {
                 if constexpr (copy)
                     ObjectView(*this).pushTo(mStack);
                 int pos = mStack.getTop();
                 (detail::pushToStack(mStack, std::forward<Args>(args)), ...);
-                call(pos, resCount);
-                if constexpr (resCount != 0)
-                {
-                    if constexpr (detail::Tuple<Ret>)
-                        return pullTuple(Type<Ret>{}, pos);
-                    else
-                    {
-                        Ret value = detail::pullFromStack<Ret>(mStack, pos);
-                        cleanUp(pos - 1);
-                        return value;
-                    }
-                }
+                call(pos, detail::resultCount<Ret>);
+                if constexpr (!std::is_void_v<Ret>)
+                    return detail::pullResults<Ret>(mStack, pos);
             }
             catch (...)
             {
-                cleanUp(top);
+                detail::popTo(mStack, top);
                 throw;
             }
         }
@@ -128,10 +146,6 @@ namespace lat
         ByteCode dump() const;
     };
 
-    // Workaround for GCC < 14 https://gcc.gnu.org/bugzilla/show_bug.cgi?id=71954
-    template <class... Types>
-    constexpr bool FunctionView::allSpecialized<std::tuple<Types...>> = (true && ... && detail::pullsOneValue<Types>);
-
     template <class Ret>
     class ReturningFunctionView
     {
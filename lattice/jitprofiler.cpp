@@ -0,0 +1,164 @@
+#include "jitprofiler.hpp"
+
+#include <lua.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <map>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+
+#include "stack.hpp"
+
+namespace lat
+{
+    namespace
+    {
+        std::atomic<bool> jitProfilerRunning = false;
+
+        constexpr std::array<const char*, jitVmStateCount> vmStateNames
+            = { "[interpreted]", "[compiled]", "[C]", "[gc]", "[compiler]" };
+
+#ifdef LAT_LUAJIT
+        JitVmState toVmState(int vmState)
+        {
+            switch (vmState)
+            {
+                case 'N':
+                    return JitVmState::Compiled;
+                case 'C':
+                    return JitVmState::C;
+                case 'G':
+                    return JitVmState::GarbageCollector;
+                case 'J':
+                    return JitVmState::Compiler;
+                default:
+                    return JitVmState::Interpreted;
+            }
+        }
+#endif
+
+        JitSampleCounts& getCounts(auto& counts, std::string_view key)
+        {
+            auto found = counts.find(key);
+            if (found == counts.end())
+                found = counts.emplace(std::string(key), JitSampleCounts{}).first;
+            return found->second;
+        }
+    }
+
+    JitProfiler::JitProfiler(const State& state, JitProfilerOptions options)
+        : mState(state)
+        , mOptions(options)
+    {
+        if (options.mInterval.count() <= 0 || options.mMaxDepth == 0)
+            throw std::invalid_argument("profiler interval and depth must be positive");
+    }
+
+    JitProfiler::~JitProfiler()
+    {
+        stop();
+    }
+
+    void JitProfiler::onSample(void* data, lua_State* state, int samples, int vmState)
+    {
+#ifdef LAT_LUAJIT
+        auto profiler = static_cast<JitProfiler*>(data);
+        const auto index = static_cast<std::size_t>(toVmState(vmState));
+        const auto count = static_cast<std::size_t>(samples);
+        // Only luaJIT_profile_dumpstack may be called here; its result lives until the next call
+        const char* format = profiler->mOptions.mLines ? "lZ;" : "FZ;";
+        std::size_t length = 0;
+        try
+        {
+            // An empty stack entry left behind by a failed location insert is skipped when folding
+            const char* stack
+                = luaJIT_profile_dumpstack(state, format, -static_cast<int>(profiler->mOptions.mMaxDepth), &length);
+            JitSampleCounts& stackCounts = getCounts(profiler->mStacks, std::string_view(stack, length));
+            const char* location = luaJIT_profile_dumpstack(state, format, 1, &length);
+            getCounts(profiler->mLocations, std::string_view(location, length))[index] += count;
+            stackCounts[index] += count;
+        }
+        catch (const std::bad_alloc&)
+        {
+            // Drop the sample rather than throw into the VM
+            return;
+        }
+        profiler->mTotals[index] += count;
+#else
+        static_cast<void>(data);
+        static_cast<void>(state);
+        static_cast<void>(samples);
+        static_cast<void>(vmState);
+#endif
+    }
+
+    void JitProfiler::start()
+    {
+#ifdef LAT_LUAJIT
+        if (mRunning)
+            return;
+        if (jitProfilerRunning.exchange(true))
+            throw std::logic_error("another profiler is running");
+        const std::string mode = std::format("{}i{}", mOptions.mLines ? 'l' : 'f', mOptions.mInterval.count());
+        mState.withStack([&](Stack& stack) { luaJIT_profile_start(stack.mState, mode.c_str(), &onSample, this); });
+        mRunning = true;
+#else
+        throw std::runtime_error("the JIT profiler requires LuaJIT");
+#endif
+    }
+
+    void JitProfiler::stop()
+    {
+#ifdef LAT_LUAJIT
+        if (!mRunning)
+            return;
+        mState.withStack([](Stack& stack) { luaJIT_profile_stop(stack.mState); });
+        jitProfilerRunning = false;
+        mRunning = false;
+#endif
+    }
+
+    void JitProfiler::clear()
+    {
+        mStacks.clear();
+        mLocations.clear();
+        mTotals = {};
+    }
+
+    std::string JitProfiler::getFoldedStacks() const
+    {
+        std::map<std::string, std::size_t> stacks;
+        for (const auto& [stack, counts] : mStacks)
+        {
+            for (std::size_t i = 0; i < jitVmStateCount; ++i)
+            {
+                if (counts[i] > 0)
+                    stacks[stack.empty() ? vmStateNames[i] : std::format("{};{}", stack, vmStateNames[i])] += counts[i];
+            }
+        }
+        std::string folded;
+        for (const auto& [stack, count] : stacks)
+            folded += std::format("{} {}\n", stack, count);
+        return folded;
+    }
+
+    std::vector<JitProfileEntry> JitProfiler::getSummary() const
+    {
+        std::vector<JitProfileEntry> entries;
+        entries.reserve(mLocations.size());
+        for (const auto& [location, counts] : mLocations)
+            entries.push_back({ location, counts });
+        auto total = [](const JitProfileEntry& entry) {
+            return std::accumulate(entry.mSamples.begin(), entry.mSamples.end(), std::size_t{ 0 });
+        };
+        std::sort(entries.begin(), entries.end(), [&](const JitProfileEntry& l, const JitProfileEntry& r) {
+            const std::size_t lTotal = total(l);
+            const std::size_t rTotal = total(r);
+            return lTotal != rTotal ? lTotal > rTotal : l.mLocation < r.mLocation;
+        });
+        return entries;
+    }
+}
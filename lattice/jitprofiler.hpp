@@ -0,0 +1,93 @@
+#ifndef LATTICE_JITPROFILER_H
+#define LATTICE_JITPROFILER_H
+
+#include "state.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+
+namespace lat
+{
+    // What the VM was doing when a sample was taken
+    enum class JitVmState
+    {
+        Interpreted,
+        Compiled,
+        C,
+        GarbageCollector,
+        Compiler,
+    };
+
+    constexpr inline std::size_t jitVmStateCount = 5;
+
+    using JitSampleCounts = std::array<std::size_t, jitVmStateCount>;
+
+    struct JitProfilerOptions
+    {
+        std::chrono::milliseconds mInterval{ 10 };
+        // Attribute samples to lines instead of functions
+        bool mLines = false;
+        std::size_t mMaxDepth = 64;
+    };
+
+    struct JitProfileEntry
+    {
+        // The function (or line) the samples were taken in
+        std::string mLocation;
+        JitSampleCounts mSamples;
+    };
+
+    // Wraps LuaJIT's own low-overhead profiler (luaJIT_profile_start), aggregating samples per stack and per innermost
+    // function, each split by VM state. Samples in a function that stay Interpreted although it runs hot point to
+    // traces failing to compile. LuaJIT only supports one profiler per process. Without LuaJIT, start throws.
+    class JitProfiler
+    {
+        struct StringHash
+        {
+            using is_transparent = void;
+
+            std::size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+        };
+
+        using Counts = std::unordered_map<std::string, JitSampleCounts, StringHash, std::equal_to<>>;
+
+        const State& mState;
+        JitProfilerOptions mOptions;
+        Counts mStacks;
+        Counts mLocations;
+        JitSampleCounts mTotals{};
+        bool mRunning = false;
+
+        JitProfiler(const JitProfiler&) = delete;
+
+        static void onSample(void* profiler, lua_State*, int samples, int vmState);
+
+    public:
+        explicit JitProfiler(const State&, JitProfilerOptions = {});
+        ~JitProfiler();
+
+        // Throws if another profiler is running
+        void start();
+        void stop();
+        bool isRunning() const { return mRunning; }
+
+        void clear();
+        const JitSampleCounts& getSampleCounts() const { return mTotals; }
+
+        // One line per distinct stack and VM state, outermost frame first, with the VM state as the innermost frame:
+        // "busy:1;busy:3;[compiled] 42"
+        std::string getFoldedStacks() const;
+        // Samples per innermost function or line, most sampled first
+        std::vector<JitProfileEntry> getSummary() const;
+    };
+}
+
+#endif
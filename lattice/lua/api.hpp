@@ -201,6 +201,8 @@ namespace lat
 
         lua_Number asNumber(int index) const noexcept { return lua_tonumber(mState, index); }
 
+        const void* asPointer(int index) const noexcept { return lua_topointer(mState, index); }
+
         lua_State* asThread(int index) const noexcept { return lua_tothread(mState, index); }
 
         void* asUserData(int index) const noexcept { return lua_touserdata(mState, index); }
@@ -19,6 +19,10 @@ namespace lat
         UserData = LUA_TUSERDATA,
         Thread = LUA_TTHREAD,
         LightUserData = LUA_TLIGHTUSERDATA,
+#ifdef LAT_LUAJIT
+        // Not part of the Lua API
+        CData = 10,
+#endif
     };
 
     enum class LuaStatus : int
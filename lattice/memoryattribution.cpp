@@ -0,0 +1,62 @@
+#include "memoryattribution.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace lat
+{
+    MemoryAttribution::MemoryAttribution(std::size_t used)
+    {
+        mOwners[defaultMemoryOwner] = { .mOwner = defaultMemoryOwner, .mLiveBytes = used };
+    }
+
+    void MemoryAttribution::record(
+        const void* pointer, std::size_t oldSize, const void* result, std::size_t newSize, MemoryOwner owner) noexcept
+    {
+        try
+        {
+            if (pointer != nullptr)
+            {
+                MemoryOwner previous = defaultMemoryOwner;
+                if (const auto found = mBlocks.find(pointer); found != mBlocks.end())
+                {
+                    previous = found->second;
+                    mBlocks.erase(found);
+                }
+                mOwners[previous].mLiveBytes -= oldSize;
+            }
+            if (newSize == 0)
+                return;
+            MemoryOwnerStats& stats = mOwners[owner];
+            stats.mOwner = owner;
+            stats.mLiveBytes += newSize;
+            stats.mAllocatedBytes += newSize;
+            ++stats.mAllocations;
+            if (owner != defaultMemoryOwner)
+                mBlocks.emplace(result, owner);
+        }
+        catch (const std::bad_alloc&)
+        {
+            // Lua cannot handle exceptions from its allocator; the block ends up charged to the default owner
+        }
+    }
+
+    MemoryOwnerStats MemoryAttribution::getStats(MemoryOwner owner) const
+    {
+        const auto found = mOwners.find(owner);
+        if (found == mOwners.end())
+            return { .mOwner = owner };
+        return found->second;
+    }
+
+    std::vector<MemoryOwnerStats> MemoryAttribution::getStats() const
+    {
+        std::vector<MemoryOwnerStats> stats;
+        stats.reserve(mOwners.size());
+        for (const auto& [owner, ownerStats] : mOwners)
+            stats.push_back(ownerStats);
+        std::sort(stats.begin(), stats.end(),
+            [](const MemoryOwnerStats& l, const MemoryOwnerStats& r) { return l.mOwner < r.mOwner; });
+        return stats;
+    }
+}
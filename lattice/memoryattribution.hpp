@@ -0,0 +1,31 @@
+#ifndef LATTICE_MEMORYATTRIBUTION_H
+#define LATTICE_MEMORYATTRIBUTION_H
+
+#include "state.hpp"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace lat
+{
+    // Remembers which owner each block was last (re)allocated for. Blocks of the default owner are not stored.
+    class MemoryAttribution
+    {
+        std::unordered_map<const void*, MemoryOwner> mBlocks;
+        std::unordered_map<MemoryOwner, MemoryOwnerStats> mOwners;
+
+    public:
+        // Blocks allocated before attribution started are charged to the default owner
+        explicit MemoryAttribution(std::size_t used);
+
+        // Called after every successful allocator call
+        void record(const void* pointer, std::size_t oldSize, const void* result, std::size_t newSize,
+            MemoryOwner owner) noexcept;
+
+        MemoryOwnerStats getStats(MemoryOwner) const;
+        std::vector<MemoryOwnerStats> getStats() const;
+    };
+}
+
+#endif
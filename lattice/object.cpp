@@ -1,5 +1,6 @@
 #include "object.hpp"
 
+#include "coroutine.hpp"
 #include "exception.hpp"
 #include "forwardstack.hpp"
 #include "function.hpp"
@@ -130,6 +131,13 @@ namespace lat
         return FunctionView(mStack, mIndex);
     }
 
+    Coroutine ObjectView::asCoroutine() const
+    {
+        if (!isCoroutine())
+            throw TypeError("coroutine");
+        return Coroutine(mStack, mIndex);
+    }
+
     std::span<std::byte> ObjectView::asUserData() const
     {
         LuaApi api = mStack.api();
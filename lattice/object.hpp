@@ -20,6 +20,7 @@ namespace lat
 
     constexpr inline Nil nil{};
 
+    class Coroutine;
     class FunctionView;
     class ObjectView;
     class Reference;
@@ -79,6 +80,7 @@ namespace lat
         TableView asTable() const;
         TableLikeView asTableLike() const;
         FunctionView asFunction() const;
+        Coroutine asCoroutine() const;
         std::span<std::byte> asUserData() const;
         void* asLightUserData() const;
 
@@ -4,9 +4,15 @@
 #include "convert.hpp"
 #include "exception.hpp"
 #include "forwardstack.hpp"
+#include "function.hpp"
 #include "table.hpp"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 
@@ -45,13 +51,26 @@ namespace lat
             }
         }
 
+        // Converted values are held by value so reference parameters don't bind to temporaries
+        template <class Arg, class T = std::remove_cvref_t<Arg>>
+        using ArgumentStorage = std::conditional_t<std::is_reference_v<Arg> && GetFromViewSpecialized<T>, T, Arg>;
+
+        template <class>
+        struct Signature;
+
         template <class R, class... Args>
-        inline std::function<int(Stack&)> wrapFunction(std::function<R(Args...)> function)
+        struct Signature<std::function<R(Args...)>>
         {
             static_assert(!detail::IndexedTable<std::remove_cvref_t<R>>, "IndexedTableView's key is likely to dangle");
-            return [function = std::move(function)]([[maybe_unused]] Stack& stack) -> int {
+
+            // Pulls the arguments off the stack, calls the function, and pushes its return values
+            template <class F>
+            static int invoke(F& function, [[maybe_unused]] Stack& stack)
+            {
                 [[maybe_unused]] int argPos = 1;
-                auto argValues = std::tuple<Args...>{ detail::pullFunctionArgument<Args>(stack, argPos)... };
+                // Arguments are read in place and left on the stack for the duration of the call
+                auto argValues = std::tuple<ArgumentStorage<Args>...>{ detail::pullFunctionArgument<ArgumentStorage<Args>>(
+                    stack, argPos)... };
                 if constexpr (std::is_void_v<R>)
                 {
                     std::apply(function, std::move(argValues));
@@ -82,60 +101,412 @@ namespace lat
                         return stack.getTop() - retPos;
                     }
                 }
-            };
+            }
+        };
+
+        // Deduces R(Args...) the same way std::function's deduction guides do, without constructing one
+        template <class F>
+        struct FunctionType
+        {
+            using type = decltype(std::function(std::declval<F&>()));
+        };
+
+        // Member functions take their object as the first argument
+        template <class R, class T, class... Args>
+        struct FunctionType<R (T::*)(Args...)>
+        {
+            using type = std::function<R(T&, Args...)>;
+        };
+
+        template <class R, class T, class... Args>
+        struct FunctionType<R (T::*)(Args...) noexcept> : FunctionType<R (T::*)(Args...)>
+        {
+        };
+
+        template <class R, class T, class... Args>
+        struct FunctionType<R (T::*)(Args...) const>
+        {
+            using type = std::function<R(const T&, Args...)>;
+        };
+
+        template <class R, class T, class... Args>
+        struct FunctionType<R (T::*)(Args...) const noexcept> : FunctionType<R (T::*)(Args...) const>
+        {
+        };
+
+        template <class F>
+        using SignatureOf = Signature<typename FunctionType<F>::type>;
+
+        template <class F>
+        concept StaticFunction = (std::is_pointer_v<F> && std::is_function_v<std::remove_pointer_t<F>>)
+            || std::is_member_function_pointer_v<F> || (std::is_empty_v<F> && Function<F>);
+
+        template <class F>
+        inline int invokeStackFunction(F& function, Stack& stack)
+        {
+            return function(stack);
+        }
+
+        // Lua user data is only guaranteed to be aligned for pointers and doubles
+        template <class F>
+        concept InlineFunction = alignof(F) <= alignof(void*);
+
+        template <InlineFunction F, int (*Invoke)(F&, Stack&)>
+        inline int invokeFunctionData(lua_State* state)
+        {
+            try
+            {
+                Stack stack(state);
+                return Invoke(*static_cast<F*>(getFunctionData(state)), stack);
+            }
+            catch (...)
+            {
+                raiseFunctionError(state);
+            }
         }
     }
 
-    template <detail::Function... Funcs>
-    class Overload
+    template <auto Function>
+    struct Bound
     {
-        using StackCheck = bool (*)(Stack&);
-        using Wrapped = std::pair<StackCheck, std::function<int(Stack&)>>;
+        static constexpr auto function = Function;
+    };
 
-        std::array<Wrapped, sizeof...(Funcs)> mOverloads;
+    // Binds a function, member function, or captureless lambda at compile time. Pushing the result creates a plain
+    // lua_CFunction without any upvalues.
+    template <auto Function>
+    constexpr inline Bound<Function> bind{};
 
-        Overload(const Overload&) = delete;
+    namespace detail
+    {
+        template <class>
+        constexpr inline bool isBound = false;
+        template <auto Function>
+        constexpr inline bool isBound<Bound<Function>> = true;
+
+        template <auto Function>
+        inline int invokeStaticFunction(lua_State* state)
+        {
+            using F = decltype(Function);
+            static_assert(StaticFunction<F>, "only functions, member functions, and captureless lambdas can be bound");
+            try
+            {
+                Stack stack(state);
+                F function = Function;
+                return SignatureOf<F>::invoke(function, stack);
+            }
+            catch (...)
+            {
+                raiseFunctionError(state);
+            }
+        }
+    }
+
+    namespace detail
+    {
+        using TypeMask = std::uint16_t;
+        constexpr inline TypeMask anyType = (1 << (CDataTag + 1)) - 1;
+
+        constexpr TypeMask typeMask(TypeTag tag)
+        {
+            return static_cast<TypeMask>(1 << tag);
+        }
+
+#ifdef LAT_LUAJIT
+        // User types can be exposed as FFI structs
+        constexpr inline TypeMask userTypeMask = static_cast<TypeMask>(typeMask(UserDataTag) | typeMask(CDataTag));
+#else
+        constexpr inline TypeMask userTypeMask = typeMask(UserDataTag);
+#endif
+
+        enum class OverloadCheck : std::uint8_t
+        {
+            // The type tags fully describe the argument
+            None,
+            // The argument validates itself when pulled, so it only needs checking to choose between overloads
+            IfAmbiguous,
+            Always,
+        };
+
+        struct ArgumentInfo
+        {
+            TypeMask mMask = anyType;
+            OverloadCheck mCheck = OverloadCheck::Always;
+            // Number of stack values taken, -1 for any number
+            int mSize = 1;
+            bool mOptional = false;
+        };
 
         template <class T>
-        static bool matches([[maybe_unused]] Stack& stack, [[maybe_unused]] int& pos)
+        constexpr ArgumentInfo getArgumentInfo();
+
+        template <class... Types>
+        constexpr ArgumentInfo getVariantInfo()
         {
-            if constexpr (std::is_base_of_v<std::remove_cvref_t<T>, Stack>)
+            const std::array<ArgumentInfo, sizeof...(Types)> types{ getArgumentInfo<Types>()... };
+            ArgumentInfo info{ 0, OverloadCheck::None };
+            for (const ArgumentInfo& type : types)
             {
-                static_assert(std::is_lvalue_reference_v<T>, "Stack can only be captured by reference");
-                return true;
+                if (type.mSize != 1)
+                    return {};
+                info.mMask |= type.mMask;
+                if (type.mCheck != OverloadCheck::None)
+                    info.mCheck = OverloadCheck::Always;
+            }
+            return info;
+        }
+
+        template <class T>
+        constexpr ArgumentInfo getArgumentInfo()
+        {
+            if constexpr (std::is_base_of_v<T, Stack>)
+                return { 0, OverloadCheck::None, 0 };
+            else if constexpr (std::is_same_v<T, Nil>)
+                return { typeMask(NilTag), OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, bool>)
+                return { typeMask(BooleanTag), OverloadCheck::None };
+            else if constexpr (Number<T>)
+                return { typeMask(NumberTag), OverloadCheck::None };
+            else if constexpr (String<T>)
+                return { typeMask(StringTag), OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, ObjectView>)
+                return { anyType, OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, TableView>)
+                return { typeMask(TableTag), OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, FunctionView> || ReturningFunction<T>)
+                return { typeMask(FunctionTag), OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, Coroutine>)
+                return { typeMask(ThreadTag), OverloadCheck::None };
+            else if constexpr (std::is_same_v<T, std::vector<ObjectView>>)
+                return { anyType, OverloadCheck::None, -1 };
+            else if constexpr ((isVector<T> || isStdArray<T> || MapContainer<T>) && IsSpecialized<T>)
+                return { typeMask(TableTag), OverloadCheck::None };
+            else if constexpr (Optional<T>)
+            {
+                ArgumentInfo info = getArgumentInfo<typename T::value_type>();
+                if (info.mSize != 1)
+                    return {};
+                info.mMask |= typeMask(NilTag);
+                info.mOptional = true;
+                return info;
             }
+            else if constexpr (Variant<T>)
+                return []<class... Types>(Type<std::variant<Types...>>) {
+                    return getVariantInfo<Types...>();
+                }(Type<T>{});
+            else if constexpr (ReferenceWrapper<T> || (std::is_class_v<T> && !IsSpecialized<T> && !PullSpecialized<T>))
+                return { userTypeMask, OverloadCheck::IfAmbiguous };
             else
+                return { anyType, OverloadCheck::Always, SingleStackPull<T> ? 1 : -1 };
+        }
+
+        // Everything needed to reject an overload from the stack's type signature alone
+        struct OverloadSignature
+        {
+            int mMinArgs = 0;
+            // -1 if any number of arguments is accepted
+            int mMaxArgs = 0;
+            // Positions described by a single type tag
+            std::uint64_t mTagMask = 0;
+            std::uint64_t mTags = 0;
+            // Positions that accept several types, or nil in place of a missing argument
+            std::array<TypeMask, maxTypeSignatureSize> mMasks{};
+            int mMaskedArgs = 0;
+            OverloadCheck mCheck = OverloadCheck::None;
+
+            constexpr bool accepts(int args) const { return args >= mMinArgs && (mMaxArgs < 0 || args <= mMaxArgs); }
+
+            constexpr bool matches(int args, std::uint64_t signature) const
             {
-                return pos <= stack.getTop() && detail::stackValueIs<T>(stack, pos);
+                if (args < mMinArgs || (signature & mTagMask) != mTags)
+                    return false;
+                for (int i = 0; i < mMaskedArgs; ++i)
+                {
+                    const int tag = static_cast<int>((signature >> (i * typeTagBits)) & ((1 << typeTagBits) - 1));
+                    if (!(mMasks[i] & (1 << tag)))
+                        return false;
+                }
+                return true;
+            }
+        };
+
+        template <class... Args>
+        constexpr OverloadSignature makeOverloadSignature()
+        {
+            const std::array<ArgumentInfo, sizeof...(Args)> args{ getArgumentInfo<std::remove_cvref_t<Args>>()... };
+            OverloadSignature signature;
+            int pos = 0;
+            for (const ArgumentInfo& arg : args)
+            {
+                if (arg.mCheck > signature.mCheck)
+                    signature.mCheck = arg.mCheck;
+                if (arg.mSize == 0)
+                    continue;
+                else if (arg.mSize < 0)
+                {
+                    // Anything after this can't be located by position
+                    if (arg.mCheck == OverloadCheck::None && &arg != &args.back())
+                        signature.mCheck = OverloadCheck::Always;
+                    signature.mMaxArgs = -1;
+                    return signature;
+                }
+                if (pos >= maxTypeSignatureSize)
+                    signature.mCheck = OverloadCheck::Always;
+                else if (arg.mMask != anyType)
+                {
+                    if (!arg.mOptional && std::has_single_bit(arg.mMask))
+                    {
+                        const int shift = pos * typeTagBits;
+                        signature.mTagMask |= std::uint64_t((1 << typeTagBits) - 1) << shift;
+                        signature.mTags |= std::uint64_t(std::countr_zero(arg.mMask)) << shift;
+                    }
+                    else
+                    {
+                        for (int i = signature.mMaskedArgs; i < pos; ++i)
+                            signature.mMasks[i] = anyType;
+                        signature.mMasks[pos] = arg.mMask;
+                        signature.mMaskedArgs = pos + 1;
+                    }
+                }
+                ++pos;
+                if (!arg.mOptional)
+                    signature.mMinArgs = pos;
             }
+            signature.mMaxArgs = pos;
+            return signature;
         }
 
+        template <class>
+        struct OverloadTraits;
+
         template <class R, class... Args>
-        static Wrapped wrap(std::function<R(Args...)> function)
+        struct OverloadTraits<std::function<R(Args...)>>
         {
-            return { []([[maybe_unused]] Stack& stack) -> bool {
-                        [[maybe_unused]] int pos = 1;
-                        return (true && ... && matches<Args>(stack, pos));
-                    },
-                detail::wrapFunction(std::move(function)) };
+            static constexpr OverloadSignature signature = makeOverloadSignature<Args...>();
+
+            template <class T>
+            static bool matches([[maybe_unused]] Stack& stack, [[maybe_unused]] int& pos)
+            {
+                if constexpr (std::is_base_of_v<std::remove_cvref_t<T>, Stack>)
+                {
+                    static_assert(std::is_lvalue_reference_v<T>, "Stack can only be captured by reference");
+                    return true;
+                }
+                else
+                {
+                    return pos <= stack.getTop() && detail::stackValueIs<T>(stack, pos);
+                }
+            }
+
+            static bool check([[maybe_unused]] Stack& stack)
+            {
+                [[maybe_unused]] int pos = 1;
+                return (true && ... && matches<Args>(stack, pos));
+            }
+        };
+    }
+
+    template <detail::Function... Funcs>
+    class Overload
+    {
+        static constexpr std::size_t size = sizeof...(Funcs);
+        static_assert(size <= std::numeric_limits<std::uint8_t>::max(), "too many overloads");
+
+        using Functions = std::tuple<Funcs...>;
+        template <std::size_t I>
+        using Traits = detail::OverloadTraits<typename detail::FunctionType<std::tuple_element_t<I, Functions>>::type>;
+
+        static constexpr std::array<detail::OverloadSignature, size> signatures
+            = []<std::size_t... I>(std::index_sequence<I...>) {
+                  return std::array<detail::OverloadSignature, size>{ Traits<I>::signature... };
+              }(std::index_sequence_for<Funcs...>{});
+
+        // Calls with more arguments than this all use the last bucket
+        static constexpr int maxArity = [] {
+            int max = 0;
+            for (const detail::OverloadSignature& signature : signatures)
+                max = std::max({ max, signature.mMinArgs, signature.mMaxArgs });
+            return max;
+        }();
+
+        struct Bucket
+        {
+            std::array<std::uint8_t, size> mOverloads{};
+            std::uint8_t mSize = 0;
+        };
+
+        // Overloads that can take each number of arguments in declaration order, followed by those that would have to
+        // ignore some of them
+        static constexpr std::array<Bucket, maxArity + 2> buckets = [] {
+            std::array<Bucket, maxArity + 2> buckets;
+            for (int args = 0; args < maxArity + 2; ++args)
+            {
+                Bucket& bucket = buckets[args];
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    if (signatures[i].accepts(args))
+                        bucket.mOverloads[bucket.mSize++] = static_cast<std::uint8_t>(i);
+                }
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    if (signatures[i].mMinArgs <= args && !signatures[i].accepts(args))
+                        bucket.mOverloads[bucket.mSize++] = static_cast<std::uint8_t>(i);
+                }
+            }
+            return buckets;
+        }();
+
+        template <std::size_t I>
+        static int invoke(Functions& functions, Stack& stack)
+        {
+            return detail::SignatureOf<std::tuple_element_t<I, Functions>>::invoke(std::get<I>(functions), stack);
+        }
+
+        static constexpr std::array<int (*)(Functions&, Stack&), size> invokers
+            = []<std::size_t... I>(std::index_sequence<I...>) {
+                  return std::array<int (*)(Functions&, Stack&), size>{ &invoke<I>... };
+              }(std::index_sequence_for<Funcs...>{});
+
+        static constexpr std::array<bool (*)(Stack&), size> checks = []<std::size_t... I>(std::index_sequence<I...>) {
+            return std::array<bool (*)(Stack&), size>{ &Traits<I>::check... };
+        }(std::index_sequence_for<Funcs...>{});
+
+        Functions mFunctions;
+
+        Overload(const Overload&) = delete;
+
+        static int dispatch(Functions& functions, Stack& stack)
+        {
+            const int args = stack.getTop();
+            const Bucket& bucket = buckets[std::min(args, maxArity + 1)];
+            const std::uint64_t types = detail::getTypeSignature(stack, args);
+            const auto matches = [&](std::uint8_t index) { return signatures[index].matches(args, types); };
+            const auto end = bucket.mOverloads.begin() + bucket.mSize;
+            for (auto it = bucket.mOverloads.begin(); it != end; ++it)
+            {
+                const std::uint8_t index = *it;
+                if (!matches(index))
+                    continue;
+                const detail::OverloadCheck check = signatures[index].mCheck;
+                if (check == detail::OverloadCheck::None
+                    || (check == detail::OverloadCheck::IfAmbiguous && std::none_of(it + 1, end, matches))
+                    || checks[index](stack))
+                    return invokers[index](functions, stack);
+            }
+            throw std::runtime_error("no matching overload found");
         }
 
     public:
         explicit Overload(Funcs&&... args)
-            : mOverloads{ wrap(std::function(std::forward<Funcs>(args)))... }
+            : mFunctions{ std::forward<Funcs>(args)... }
         {
-            static_assert(sizeof...(Funcs) > 1, "Overloading requires at least two functions");
+            static_assert(size > 1, "Overloading requires at least two functions");
         }
 
-        std::function<int(Stack&)> toFunction() &&
+        auto toFunction() &&
         {
-            return [pairs = std::move(mOverloads)](Stack& stack) -> int {
-                for (const Wrapped& pair : pairs)
-                {
-                    if (pair.first(stack))
-                        return pair.second(stack);
-                }
-                throw std::runtime_error("no matching overload found");
+            return [functions = std::move(mFunctions)](Stack& stack) mutable -> int {
+                return dispatch(functions, stack);
             };
         }
     };
@@ -145,6 +516,12 @@ namespace lat
     {
         stack.pushFunction(std::move(overload));
     }
+
+    template <auto Function>
+    inline void pushValue(Stack& stack, Bound<Function>)
+    {
+        stack.pushFunction<Function>();
+    }
 }
 
 #endif
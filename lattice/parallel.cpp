@@ -0,0 +1,121 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace lat
+{
+    namespace
+    {
+        // Batch indices [mBegin, mEnd) owned by one worker. The owner takes from the front, thieves from the back.
+        struct BatchQueue
+        {
+            std::mutex mMutex;
+            std::size_t mBegin = 0;
+            std::size_t mEnd = 0;
+
+            std::optional<std::size_t> popFront()
+            {
+                std::lock_guard lock(mMutex);
+                if (mBegin == mEnd)
+                    return {};
+                return mBegin++;
+            }
+
+            // Takes the back half
+            std::optional<std::pair<std::size_t, std::size_t>> steal()
+            {
+                std::lock_guard lock(mMutex);
+                const std::size_t size = mEnd - mBegin;
+                if (size == 0)
+                    return {};
+                const std::size_t end = mEnd;
+                mEnd -= (size + 1) / 2;
+                return std::pair(mEnd, end);
+            }
+
+            void assign(std::size_t begin, std::size_t end)
+            {
+                std::lock_guard lock(mMutex);
+                mBegin = begin;
+                mEnd = end;
+            }
+        };
+    }
+
+    void detail::runBatches(StatePool& pool, std::size_t count, std::size_t batchSize,
+        FunctionRef<void(Stack&, NextBatch)> work)
+    {
+        if (batchSize == 0)
+            throw std::invalid_argument("batch size must be positive");
+        if (count == 0)
+            return;
+        const std::size_t batches = (count + batchSize - 1) / batchSize;
+        const std::size_t workers = std::min(pool.size(), batches);
+        std::vector<BatchQueue> queues(workers);
+        for (std::size_t i = 0; i < workers; ++i)
+            queues[i].assign(batches * i / workers, batches * (i + 1) / workers);
+
+        std::atomic<bool> failed = false;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        const auto run = [&](std::size_t worker) {
+            try
+            {
+                const auto next = [&](std::size_t& begin, std::size_t& end) {
+                    if (failed)
+                        return false;
+                    std::optional<std::size_t> batch = queues[worker].popFront();
+                    for (std::size_t i = 1; !batch && i < workers; ++i)
+                    {
+                        if (auto stolen = queues[(worker + i) % workers].steal())
+                        {
+                            batch = stolen->first;
+                            queues[worker].assign(stolen->first + 1, stolen->second);
+                        }
+                    }
+                    if (!batch)
+                        return false;
+                    begin = *batch * batchSize;
+                    end = std::min(begin + batchSize, count);
+                    return true;
+                };
+                StatePool::Handle state = pool.checkout();
+                state->withStack([&](Stack& stack) { work(stack, next); });
+            }
+            catch (...)
+            {
+                std::lock_guard lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+            }
+        };
+        std::vector<std::thread> threads;
+        try
+        {
+            threads.reserve(workers - 1);
+            for (std::size_t i = 1; i < workers; ++i)
+                threads.emplace_back(run, i);
+        }
+        catch (...)
+        {
+            failed = true;
+            for (std::thread& thread : threads)
+                thread.join();
+            throw;
+        }
+        // The calling thread does its share too
+        run(0);
+        for (std::thread& thread : threads)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
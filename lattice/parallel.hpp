@@ -0,0 +1,94 @@
+#ifndef LATTICE_PARALLEL_H
+#define LATTICE_PARALLEL_H
+
+#include "functionref.hpp"
+#include "stack.hpp"
+#include "statepool.hpp"
+
+#include <concepts>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lat
+{
+    namespace detail
+    {
+        // Produces the next range of items for a worker, returning false once every batch has been handed out
+        using NextBatch = FunctionRef<bool(std::size_t&, std::size_t&)>;
+
+        // Splits [0, count) into batches and runs work on up to pool.size() threads, each with its own checked out
+        // state. Every thread starts on a contiguous share of the batches and steals from the others once it runs out.
+        // The first exception thrown by any thread is rethrown after all of them stopped.
+        void runBatches(StatePool& pool, std::size_t count, std::size_t batchSize,
+            FunctionRef<void(Stack&, NextBatch)> work);
+
+        // std::vector<bool> cannot be written from several threads
+        template <class Out>
+        using MapStorage = std::conditional_t<std::is_same_v<Out, bool>, std::vector<char>, std::vector<Out>>;
+
+        template <class Out, class In>
+        void mapBatches(FunctionView function, std::span<const In> inputs, MapStorage<Out>& outputs, NextBatch next)
+        {
+            std::size_t begin;
+            std::size_t end;
+            while (next(begin, end))
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                    outputs[i] = function.invoke<Out>(inputs[i]);
+            }
+        }
+
+        template <class Out, class In>
+        std::vector<Out> map(StatePool& pool, std::span<const In> inputs, std::size_t batchSize,
+            FunctionRef<FunctionView(Stack&)> getFunction)
+        {
+            MapStorage<Out> outputs(inputs.size());
+            runBatches(pool, inputs.size(), batchSize, [&](Stack& stack, NextBatch next) {
+                mapBatches<Out>(getFunction(stack), inputs, outputs, next);
+            });
+            if constexpr (std::is_same_v<Out, bool>)
+                return std::vector<bool>(outputs.begin(), outputs.end());
+            else
+                return outputs;
+        }
+    }
+
+    // Calls the global function name once for every input, spread over the pool's states, and returns the results in
+    // input order. The calling thread must not have a state of the pool checked out.
+    template <std::default_initializable Out, class In>
+    std::vector<Out> parallelMap(
+        StatePool& pool, std::string_view name, std::span<const In> inputs, std::size_t batchSize = 256)
+    {
+        const std::string global(name);
+        return detail::map<Out>(
+            pool, inputs, batchSize, [&](Stack& stack) -> FunctionView { return stack[global.c_str()]; });
+    }
+
+    // Like parallelMap, for the function returned by chunk. Each state executes the chunk once.
+    template <std::default_initializable Out, class In>
+    std::vector<Out> parallelMapChunk(
+        StatePool& pool, std::string_view chunk, std::span<const In> inputs, std::size_t batchSize = 256)
+    {
+        return detail::map<Out>(
+            pool, inputs, batchSize, [&](Stack& stack) { return stack.execute<FunctionView>(chunk); });
+    }
+
+    // Maps like parallelMap, then folds the results in input order with reduce(accumulated, result)
+    template <std::default_initializable Out, class In, class Acc, class Reduce>
+    Acc parallelReduce(StatePool& pool, std::string_view name, std::span<const In> inputs, Acc initial,
+        Reduce&& reduce, std::size_t batchSize = 256)
+    {
+        std::vector<Out> outputs = parallelMap<Out>(pool, name, inputs, batchSize);
+        for (auto&& output : outputs)
+            initial = reduce(std::move(initial), std::move(output));
+        return initial;
+    }
+}
+
+#endif
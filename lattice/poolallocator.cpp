@@ -0,0 +1,226 @@
+#include "poolallocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace lat
+{
+    namespace
+    {
+        // Free blocks a thread keeps per size class before handing a batch back
+        constexpr std::size_t threadCacheCapacity = 64;
+        constexpr std::size_t threadCacheBatch = 32;
+
+        std::atomic<std::uint64_t> nextAllocatorId = 1;
+
+        constexpr std::size_t getSizeClass(std::size_t size)
+        {
+            return (size - 1) / PoolAllocator::granularity;
+        }
+
+        constexpr std::size_t getClassSize(std::size_t sizeClass)
+        {
+            return (sizeClass + 1) * PoolAllocator::granularity;
+        }
+
+        static_assert(PoolAllocator::granularity % alignof(std::max_align_t) == 0);
+        static_assert(getSizeClass(PoolAllocator::maxSmallSize) == PoolAllocator::classCount - 1);
+    }
+
+    struct PoolAllocator::ThreadCache
+    {
+        std::uint64_t mId;
+        // Blocks are returned on thread exit if the allocator is still around
+        std::weak_ptr<Central> mCentral;
+        std::array<FreeList, classCount> mFree;
+
+        ThreadCache(std::uint64_t id, std::weak_ptr<Central> central)
+            : mId(id)
+            , mCentral(std::move(central))
+        {
+        }
+
+        ~ThreadCache()
+        {
+            std::shared_ptr<Central> central = mCentral.lock();
+            if (!central)
+                return;
+            std::lock_guard lock(central->mMutex);
+            for (std::size_t sizeClass = 0; sizeClass < classCount; ++sizeClass)
+            {
+                while (void* block = mFree[sizeClass].pop())
+                    central->free(sizeClass, block);
+            }
+        }
+    };
+
+    void PoolAllocator::FreeList::push(void* block)
+    {
+        mHead = new (block) FreeBlock{ mHead };
+        ++mCount;
+    }
+
+    void* PoolAllocator::FreeList::pop()
+    {
+        FreeBlock* block = mHead;
+        if (block != nullptr)
+        {
+            mHead = block->mNext;
+            --mCount;
+        }
+        return block;
+    }
+
+    void* PoolAllocator::Central::allocate(std::size_t sizeClass)
+    {
+        if (void* block = mFree[sizeClass].pop())
+            return block;
+        const std::size_t size = getClassSize(sizeClass);
+        if (static_cast<std::size_t>(mEnd[sizeClass] - mNext[sizeClass]) < size)
+        {
+            std::unique_ptr<std::byte[]> slab(new (std::nothrow) std::byte[slabSize]);
+            if (!slab)
+                return nullptr;
+            try
+            {
+                mSlabs.push_back(std::move(slab));
+            }
+            catch (const std::bad_alloc&)
+            {
+                return nullptr;
+            }
+            mNext[sizeClass] = mSlabs.back().get();
+            mEnd[sizeClass] = mNext[sizeClass] + slabSize;
+        }
+        void* block = mNext[sizeClass];
+        mNext[sizeClass] += size;
+        return block;
+    }
+
+    void PoolAllocator::Central::free(std::size_t sizeClass, void* block)
+    {
+        mFree[sizeClass].push(block);
+    }
+
+    PoolAllocator::PoolAllocator(bool threadCache)
+        : mCentral(std::make_shared<Central>())
+        , mThreadCache(threadCache)
+    {
+        mCentral->mId = nextAllocatorId++;
+    }
+
+    PoolAllocator::~PoolAllocator() = default;
+
+    PoolAllocator::ThreadCache& PoolAllocator::getThreadCache()
+    {
+        thread_local std::vector<std::unique_ptr<ThreadCache>> caches;
+        // Trivially destructible, so checking it skips the guard of caches on every call
+        thread_local ThreadCache* last = nullptr;
+        const std::uint64_t id = mCentral->mId;
+        if (last != nullptr && last->mId == id)
+            return *last;
+        for (const std::unique_ptr<ThreadCache>& cache : caches)
+        {
+            if (cache->mId == id)
+                return *(last = cache.get());
+        }
+        std::erase_if(caches, [](const std::unique_ptr<ThreadCache>& cache) { return cache->mCentral.expired(); });
+        last = caches.emplace_back(std::make_unique<ThreadCache>(id, mCentral)).get();
+        return *last;
+    }
+
+    void* PoolAllocator::allocateSmall(std::size_t sizeClass)
+    {
+        if (!mThreadCache)
+            return mCentral->allocate(sizeClass);
+        FreeList& cached = getThreadCache().mFree[sizeClass];
+        if (void* block = cached.pop())
+            return block;
+        std::lock_guard lock(mCentral->mMutex);
+        for (std::size_t i = 1; i < threadCacheBatch; ++i)
+        {
+            void* block = mCentral->allocate(sizeClass);
+            if (block == nullptr)
+                break;
+            cached.push(block);
+        }
+        return mCentral->allocate(sizeClass);
+    }
+
+    void PoolAllocator::freeSmall(std::size_t sizeClass, void* block)
+    {
+        if (!mThreadCache)
+            return mCentral->free(sizeClass, block);
+        FreeList& cached = getThreadCache().mFree[sizeClass];
+        cached.push(block);
+        if (cached.mCount <= threadCacheCapacity)
+            return;
+        std::lock_guard lock(mCentral->mMutex);
+        while (cached.mCount > threadCacheCapacity - threadCacheBatch)
+            mCentral->free(sizeClass, cached.pop());
+    }
+
+    void* PoolAllocator::reallocate(void* pointer, std::size_t oldSize, std::size_t newSize)
+    {
+        if (pointer == nullptr)
+            oldSize = 0;
+        if (newSize == 0)
+        {
+            if (pointer == nullptr)
+                return nullptr;
+            if (oldSize <= maxSmallSize)
+                freeSmall(getSizeClass(oldSize), pointer);
+            else
+            {
+                std::free(pointer);
+                --mLargeCount;
+                mLargeBytes -= oldSize;
+            }
+            return nullptr;
+        }
+        if (oldSize > maxSmallSize && newSize > maxSmallSize)
+        {
+            void* resized = std::realloc(pointer, newSize);
+            if (resized != nullptr)
+            {
+                mLargeBytes += newSize;
+                mLargeBytes -= oldSize;
+            }
+            return resized;
+        }
+        if (oldSize != 0 && oldSize <= maxSmallSize && newSize <= maxSmallSize
+            && getSizeClass(oldSize) == getSizeClass(newSize))
+            return pointer;
+        void* moved;
+        if (newSize <= maxSmallSize)
+            moved = allocateSmall(getSizeClass(newSize));
+        else
+        {
+            moved = std::malloc(newSize);
+            if (moved != nullptr)
+            {
+                ++mLargeCount;
+                mLargeBytes += newSize;
+            }
+        }
+        if (moved != nullptr && pointer != nullptr)
+        {
+            std::memcpy(moved, pointer, std::min(oldSize, newSize));
+            reallocate(pointer, oldSize, 0);
+        }
+        return moved;
+    }
+
+    PoolAllocatorStats PoolAllocator::getStats() const
+    {
+        PoolAllocatorStats stats{ .mLargeCount = mLargeCount, .mLargeBytes = mLargeBytes };
+        std::unique_lock<std::mutex> lock;
+        if (mThreadCache)
+            lock = std::unique_lock(mCentral->mMutex);
+        stats.mSlabCount = mCentral->mSlabs.size();
+        stats.mSlabBytes = stats.mSlabCount * slabSize;
+        return stats;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef LATTICE_POOLALLOCATOR_H
+#define LATTICE_POOLALLOCATOR_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lat
+{
+    struct PoolAllocatorStats
+    {
+        std::size_t mSlabCount;
+        std::size_t mSlabBytes;
+        // Allocations too large for a size class, passed on to malloc
+        std::size_t mLargeCount;
+        std::size_t mLargeBytes;
+    };
+
+    // Serves Lua's small objects (strings, tables, closures, upvalues) from fixed size classes carved out of slabs and
+    // everything larger from malloc. Pass allocate to the State constructor:
+    //     PoolAllocator allocator;
+    //     State state(&PoolAllocator::allocate, &allocator);
+    // Without the thread cache, only one thread at a time may use the allocator, which holds for the states of a single
+    // thread. With it, each thread keeps a few free blocks of its own and only locks to exchange them in batches, so
+    // states used from different threads can share the allocator. Slab memory is only released on destruction and the
+    // allocator must outlive its states.
+    class PoolAllocator
+    {
+    public:
+        static constexpr std::size_t granularity = 16;
+        static constexpr std::size_t maxSmallSize = 256;
+        static constexpr std::size_t classCount = maxSmallSize / granularity;
+        static constexpr std::size_t slabSize = 64 * 1024;
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock* mNext;
+        };
+
+        struct FreeList
+        {
+            FreeBlock* mHead = nullptr;
+            std::size_t mCount = 0;
+
+            void push(void*);
+            void* pop();
+        };
+
+        struct Central
+        {
+            std::mutex mMutex;
+            std::uint64_t mId;
+            std::array<FreeList, classCount> mFree;
+            // Unused tail of each class' newest slab
+            std::array<std::byte*, classCount> mNext{};
+            std::array<std::byte*, classCount> mEnd{};
+            std::vector<std::unique_ptr<std::byte[]>> mSlabs;
+
+            void* allocate(std::size_t sizeClass);
+            void free(std::size_t sizeClass, void*);
+        };
+
+        struct ThreadCache;
+
+        std::shared_ptr<Central> mCentral;
+        std::atomic<std::size_t> mLargeCount = 0;
+        std::atomic<std::size_t> mLargeBytes = 0;
+        bool mThreadCache;
+
+        PoolAllocator(const PoolAllocator&) = delete;
+
+        ThreadCache& getThreadCache();
+        void* allocateSmall(std::size_t sizeClass);
+        void freeSmall(std::size_t sizeClass, void*);
+        void* reallocate(void* pointer, std::size_t oldSize, std::size_t newSize);
+
+    public:
+        explicit PoolAllocator(bool threadCache = false);
+        ~PoolAllocator();
+
+        // Matches Allocator<PoolAllocator>
+        static void* allocate(PoolAllocator* allocator, void* pointer, std::size_t oldSize, std::size_t newSize)
+        {
+            return allocator->reallocate(pointer, oldSize, newSize);
+        }
+
+        bool hasThreadCache() const { return mThreadCache; }
+        PoolAllocatorStats getStats() const;
+    };
+}
+
+#endif
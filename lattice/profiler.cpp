@@ -0,0 +1,182 @@
+#include "profiler.hpp"
+
+#include <lua.hpp>
+
+#include <atomic>
+#include <format>
+#include <map>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include "stack.hpp"
+
+namespace lat
+{
+    namespace
+    {
+        std::atomic<Profiler*> activeProfiler = nullptr;
+        static_assert(std::atomic<Profiler*>::is_always_lock_free);
+
+#ifndef _WIN32
+        struct sigaction previousAction;
+
+        void setTimer(std::chrono::microseconds interval)
+        {
+            itimerval timer{};
+            timer.it_interval.tv_sec = static_cast<time_t>(interval.count() / 1000000);
+            timer.it_interval.tv_usec = static_cast<suseconds_t>(interval.count() % 1000000);
+            timer.it_value = timer.it_interval;
+            if (setitimer(ITIMER_REAL, &timer, nullptr) != 0)
+                throw std::runtime_error("failed to set profiling timer");
+        }
+#endif
+    }
+
+    void Profiler::Sampler::operator()(Stack& stack) const
+    {
+        mProfiler->sample(stack);
+    }
+
+    Profiler::Profiler(const State& state, ProfilerOptions options)
+        : mState(state)
+        , mOptions(options)
+    {
+        if (options.mInterval.count() <= 0 || options.mCapacity == 0 || options.mMaxDepth == 0)
+            throw std::invalid_argument("profiler interval, capacity and depth must be positive");
+        mFrames.resize(options.mCapacity * options.mMaxDepth);
+        mDepths.resize(options.mCapacity);
+    }
+
+    Profiler::~Profiler()
+    {
+        stop();
+    }
+
+    void Profiler::onTimer(int)
+    {
+        if (Profiler* profiler = activeProfiler.load())
+            profiler->mState.requestSample();
+    }
+
+    void Profiler::start()
+    {
+#ifdef _WIN32
+        throw std::runtime_error("sampling is not supported on this platform");
+#else
+        if (mRunning)
+            return;
+        Profiler* expected = nullptr;
+        if (!activeProfiler.compare_exchange_strong(expected, this))
+            throw std::logic_error("another profiler is running");
+        mState.setSampler(FunctionRef<void(Stack&)>(mSampler));
+        struct sigaction action = {};
+        action.sa_handler = &onTimer;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGALRM, &action, &previousAction);
+        mRunning = true;
+        setTimer(mOptions.mInterval);
+#endif
+    }
+
+    void Profiler::stop()
+    {
+#ifndef _WIN32
+        if (!mRunning)
+            return;
+        setTimer(std::chrono::microseconds(0));
+        // Ignoring the signal discards one that is still pending, before the previous handler gets to see it
+        signal(SIGALRM, SIG_IGN);
+        sigaction(SIGALRM, &previousAction, nullptr);
+        activeProfiler.store(nullptr);
+        mState.setSampler({});
+        mRunning = false;
+#endif
+    }
+
+    void Profiler::clear()
+    {
+        mNext = 0;
+        mSize = 0;
+        mDropped = 0;
+    }
+
+    std::uint32_t Profiler::getFrameId()
+    {
+        if (const auto found = mFrameIds.find(mFrameName); found != mFrameIds.end())
+            return found->second;
+        const auto id = static_cast<std::uint32_t>(mFrameNames.size());
+        const auto [inserted, _] = mFrameIds.emplace(mFrameName, id);
+        mFrameNames.push_back(inserted->first);
+        return id;
+    }
+
+    void Profiler::sample(Stack& stack)
+    {
+        lua_State* state = stack.mState;
+        std::uint32_t* frames = mFrames.data() + mNext * mOptions.mMaxDepth;
+        std::uint32_t depth = 0;
+        lua_Debug activationRecord;
+        try
+        {
+            for (; depth < mOptions.mMaxDepth && lua_getstack(state, static_cast<int>(depth), &activationRecord);
+                 ++depth)
+            {
+                lua_getinfo(state, "Sn", &activationRecord);
+                const char* name = activationRecord.name ? activationRecord.name : "?";
+                // Appended piece by piece so the buffer's capacity is reused
+                mFrameName.clear();
+                if (*activationRecord.what == 'C')
+                    mFrameName.append(name).append(" [C]");
+                else if (*activationRecord.what == 'm')
+                    mFrameName.append("main (").append(activationRecord.short_src).append(")");
+                else
+                {
+                    mFrameName.append(name).append(" (").append(activationRecord.short_src).append(":");
+                    mFrameName.append(std::to_string(activationRecord.linedefined)).append(")");
+                }
+                frames[depth] = getFrameId();
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return;
+        }
+        if (depth == 0)
+            return;
+        mDepths[mNext] = depth;
+        mNext = (mNext + 1) % mOptions.mCapacity;
+        if (mSize < mOptions.mCapacity)
+            ++mSize;
+        else
+            ++mDropped;
+    }
+
+    std::string Profiler::getFoldedStacks() const
+    {
+        std::map<std::string, std::size_t> stacks;
+        std::string line;
+        for (std::size_t i = 0; i < mSize; ++i)
+        {
+            const std::size_t index = (mNext + mOptions.mCapacity - mSize + i) % mOptions.mCapacity;
+            const std::uint32_t* frames = mFrames.data() + index * mOptions.mMaxDepth;
+            line.clear();
+            for (std::uint32_t depth = mDepths[index]; depth > 0; --depth)
+            {
+                if (!line.empty())
+                    line += ';';
+                line += mFrameNames[frames[depth - 1]];
+            }
+            ++stacks[line];
+        }
+        std::string folded;
+        for (const auto& [stack, count] : stacks)
+            folded += std::format("{} {}\n", stack, count);
+        return folded;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef LATTICE_PROFILER_H
+#define LATTICE_PROFILER_H
+
+#include "state.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lat
+{
+    struct ProfilerOptions
+    {
+        // Wall-clock time between samples
+        std::chrono::microseconds mInterval{ 1000 };
+        // Samples kept before the oldest are overwritten
+        std::size_t mCapacity = 10000;
+        // Frames kept per sample, counting from the innermost one
+        std::size_t mMaxDepth = 64;
+    };
+
+    // Samples the Lua call stack of a State at a fixed interval. A POSIX interval timer (ITIMER_REAL, so SIGALRM)
+    // arms the state's count hook for a single instruction, which then records the stack into a preallocated ring
+    // buffer; no hook runs between samples. Only one profiler can run per process.
+    // Samples are only taken while Lua code runs on the main thread or a coroutine resumed from C++ (every thread with
+    // LuaJIT) and, with LuaJIT, outside of compiled traces. Not supported on Windows.
+    class Profiler
+    {
+        struct Sampler
+        {
+            Profiler* mProfiler;
+
+            void operator()(Stack&) const;
+        };
+
+        struct StringHash
+        {
+            using is_transparent = void;
+
+            std::size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+        };
+
+        const State& mState;
+        ProfilerOptions mOptions;
+        Sampler mSampler{ this };
+        std::unordered_map<std::string, std::uint32_t, StringHash, std::equal_to<>> mFrameIds;
+        std::vector<std::string_view> mFrameNames;
+        // mCapacity samples of mMaxDepth frame ids each, innermost first
+        std::vector<std::uint32_t> mFrames;
+        std::vector<std::uint32_t> mDepths;
+        std::string mFrameName;
+        std::size_t mNext = 0;
+        std::size_t mSize = 0;
+        std::size_t mDropped = 0;
+        bool mRunning = false;
+
+        Profiler(const Profiler&) = delete;
+
+        void sample(Stack&);
+        std::uint32_t getFrameId();
+
+        static void onTimer(int);
+
+    public:
+        explicit Profiler(const State&, ProfilerOptions = {});
+        ~Profiler();
+
+        // Throws if another profiler is running
+        void start();
+        void stop();
+        bool isRunning() const { return mRunning; }
+
+        void clear();
+        std::size_t getSampleCount() const { return mSize; }
+        // Samples overwritten since the last clear
+        std::size_t getDroppedCount() const { return mDropped; }
+
+        // One line per distinct stack, outermost frame first: "main (chunk);update (chunk:10) 42"
+        std::string getFoldedStacks() const;
+    };
+}
+
+#endif
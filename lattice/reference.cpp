@@ -30,6 +30,11 @@ namespace lat
     {
     }
 
+    Reference::Reference(CoroutineReference&& other)
+        : Reference(std::move(other.mReference))
+    {
+    }
+
     Reference::~Reference()
     {
         reset();
@@ -108,6 +113,11 @@ namespace lat
         return *this = std::move(other.mReference);
     }
 
+    Reference& Reference::operator=(CoroutineReference&& other)
+    {
+        return *this = std::move(other.mReference);
+    }
+
     FunctionReference::FunctionReference(Reference&& ref)
         : mReference(std::move(ref))
     {
@@ -168,6 +178,36 @@ namespace lat
         mReference = ObjectView(object);
     }
 
+    CoroutineReference::CoroutineReference(Reference&& ref)
+        : mReference(std::move(ref))
+    {
+    }
+
+    void CoroutineReference::reset()
+    {
+        mReference.reset();
+    }
+
+    bool CoroutineReference::isValid() const
+    {
+        return mReference.isValid();
+    }
+
+    Coroutine CoroutineReference::pushTo(Stack& stack) const
+    {
+        return mReference.pushTo(stack).asCoroutine();
+    }
+
+    void CoroutineReference::onStack(FunctionRef<void(Stack&, Coroutine)> function) const
+    {
+        mReference.onStack([&](Stack& stack, ObjectView view) { function(stack, view.asCoroutine()); });
+    }
+
+    void CoroutineReference::operator=(const Coroutine& object)
+    {
+        mReference = ObjectView(object);
+    }
+
     void swap(Reference& l, Reference& r)
     {
         std::swap(l.mState, r.mState);
@@ -208,6 +248,16 @@ namespace lat
         return l.mReference == r.mReference;
     }
 
+    bool operator==(const Reference& l, const CoroutineReference& r)
+    {
+        return l == r.mReference;
+    }
+
+    bool operator==(const CoroutineReference& l, const CoroutineReference& r)
+    {
+        return l.mReference == r.mReference;
+    }
+
     void pushValue(Stack& stack, const Reference& value)
     {
         value.pushTo(stack);
@@ -222,4 +272,9 @@ namespace lat
     {
         value.pushTo(stack);
     }
+
+    void pushValue(Stack& stack, const CoroutineReference& value)
+    {
+        value.pushTo(stack);
+    }
 }
@@ -7,11 +7,13 @@ struct lua_State;
 
 namespace lat
 {
+    class Coroutine;
     class FunctionView;
     class ObjectView;
     class Stack;
     class TableView;
 
+    class CoroutineReference;
     class FunctionReference;
     class TableReference;
 
@@ -34,10 +36,12 @@ namespace lat
         Reference(Reference&&);
         Reference(FunctionReference&&);
         Reference(TableReference&&);
+        Reference(CoroutineReference&&);
 
         Reference& operator=(Reference&&);
         Reference& operator=(FunctionReference&&);
         Reference& operator=(TableReference&&);
+        Reference& operator=(CoroutineReference&&);
 
         friend void swap(Reference&, Reference&);
 
@@ -105,9 +109,34 @@ namespace lat
         friend bool operator==(const TableReference&, const FunctionReference&);
     };
 
+    class CoroutineReference
+    {
+        Reference mReference;
+
+        CoroutineReference(Reference&&);
+
+        friend class Coroutine;
+        friend class Reference;
+
+    public:
+        CoroutineReference() = default;
+
+        void reset();
+        bool isValid() const;
+
+        Coroutine pushTo(Stack&) const;
+        void onStack(FunctionRef<void(Stack&, Coroutine)>) const;
+
+        void operator=(const Coroutine&);
+
+        friend bool operator==(const Reference&, const CoroutineReference&);
+        friend bool operator==(const CoroutineReference&, const CoroutineReference&);
+    };
+
     void pushValue(Stack&, const Reference&);
     void pushValue(Stack&, const FunctionReference&);
     void pushValue(Stack&, const TableReference&);
+    void pushValue(Stack&, const CoroutineReference&);
 }
 
 #endif
@@ -0,0 +1,429 @@
+#include "scheduler.hpp"
+
+#include "coroutine.hpp"
+#include "lua/api.hpp"
+#include "state.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace
+{
+    std::uint32_t getIndex(lat::TaskId id)
+    {
+        return static_cast<std::uint32_t>(id);
+    }
+
+    std::uint32_t getGeneration(lat::TaskId id)
+    {
+        return static_cast<std::uint32_t>(id >> 32);
+    }
+
+    lat::TaskId makeTaskId(std::uint32_t index, std::uint32_t generation)
+    {
+        return (static_cast<lat::TaskId>(generation) << 32) | index;
+    }
+
+    lat::Scheduler& getScheduler(lat::LuaApi& api)
+    {
+        lat::Scheduler* scheduler = *static_cast<lat::Scheduler**>(api.asUserData(lua_upvalueindex(1)));
+        if (scheduler == nullptr)
+        {
+            api.pushCString("scheduler destroyed");
+            api.error();
+        }
+        return *scheduler;
+    }
+}
+
+namespace lat
+{
+    Scheduler::Scheduler(const State& state)
+        : mState(state)
+    {
+    }
+
+    Scheduler::~Scheduler()
+    {
+        // The registered functions can outlive the scheduler
+        if (mSelf != nullptr)
+            *mSelf = nullptr;
+    }
+
+    void Scheduler::registerFunctions(const TableView& table)
+    {
+        const std::pair<const char*, lua_CFunction> functions[] = {
+            { "sleep", &Scheduler::sleep },
+            { "sleepUntil", &Scheduler::sleepUntil },
+            { "waitFrames", &Scheduler::waitFrames },
+            { "waitUntilFrame", &Scheduler::waitUntilFrame },
+            { "wait", &Scheduler::wait },
+        };
+        Stack& stack = table.getStack();
+        const int index = stack.makeAbsolute(table.getIndex());
+        stack.ensure(4);
+        LuaApi api = stack.api();
+        if (mSelf == nullptr)
+        {
+            auto self = new (stack.pushUserData(sizeof(Scheduler*)).data()) Scheduler*(this);
+            try
+            {
+                mSelfReference = stack.store(-1);
+            }
+            catch (...)
+            {
+                stack.pop();
+                throw;
+            }
+            mSelf = self;
+        }
+        else
+            mSelfReference.pushTo(stack);
+        const int self = stack.getTop();
+        for (const auto& [name, function] : functions)
+        {
+            api.pushCString(name);
+            api.pushCopy(self);
+            api.pushFunction(function, 1);
+            api.setRawTableEntry(index);
+        }
+        stack.pop();
+    }
+
+    TaskId Scheduler::spawn(const FunctionView& function)
+    {
+        Stack& stack = function.getStack();
+        const Coroutine coroutine = stack.pushCoroutine(function);
+        try
+        {
+            const TaskId id = add(coroutine.store(), true);
+            stack.pop();
+            return id;
+        }
+        catch (...)
+        {
+            stack.pop();
+            throw;
+        }
+    }
+
+    TaskId Scheduler::spawn(const Coroutine& coroutine)
+    {
+        return add(coroutine.store(), false);
+    }
+
+    TaskId Scheduler::add(CoroutineReference&& coroutine, bool owned)
+    {
+        std::uint32_t index;
+        if (mFreeTasks.empty())
+        {
+            index = static_cast<std::uint32_t>(mTasks.size());
+            mTasks.emplace_back();
+        }
+        else
+        {
+            index = mFreeTasks.back();
+            mFreeTasks.pop_back();
+        }
+        Task& task = mTasks[index];
+        task.mCoroutine = std::move(coroutine);
+        task.mAlive = true;
+        task.mWaiting = false;
+        task.mOwned = owned;
+        task.mSignal = nullptr;
+        const TaskId id = makeTaskId(index, ++task.mGeneration);
+        ++mTaskCount;
+        mReady.push_back(id);
+        return id;
+    }
+
+    Scheduler::Task* Scheduler::getTask(TaskId id)
+    {
+        const std::uint32_t index = getIndex(id);
+        if (index >= mTasks.size())
+            return nullptr;
+        Task& task = mTasks[index];
+        if (!task.mAlive || task.mGeneration != getGeneration(id))
+            return nullptr;
+        return &task;
+    }
+
+    bool Scheduler::isAlive(TaskId id) const
+    {
+        const std::uint32_t index = getIndex(id);
+        return index < mTasks.size() && mTasks[index].mAlive && mTasks[index].mGeneration == getGeneration(id);
+    }
+
+    void Scheduler::remove(TaskId id)
+    {
+        Task* task = getTask(id);
+        if (task == nullptr)
+            return;
+        if (task->mWaiting && task->mSignal != nullptr)
+        {
+            auto found = mSignals.find(*task->mSignal);
+            std::erase_if(found->second, [&](const Waiter& waiter) { return waiter.mTask == id; });
+            if (found->second.empty())
+                mSignals.erase(found);
+        }
+        else if (task->mWaiting)
+            ++mStaleDeadlines;
+        task->mCoroutine.reset();
+        task->mAlive = false;
+        task->mWaiting = false;
+        task->mSignal = nullptr;
+        mFreeTasks.push_back(getIndex(id));
+        --mTaskCount;
+        if (mStaleDeadlines * 2 > mTimers.size() + mFrameWaits.size())
+            pruneDeadlines();
+    }
+
+    void Scheduler::pruneDeadlines()
+    {
+        // Reserving up front leaves the queue untouched if it fails, and stale deadlines are harmless
+        const auto prune = [&]<class T>(DeadlineQueue<T>& queue) {
+            std::vector<Deadline<T>> deadlines;
+            deadlines.reserve(queue.size());
+            for (; !queue.empty(); queue.pop())
+            {
+                if (isWaiting(queue.top().mWaiter))
+                    deadlines.push_back(queue.top());
+            }
+            queue = DeadlineQueue<T>(std::greater<>(), std::move(deadlines));
+        };
+        try
+        {
+            prune(mTimers);
+            prune(mFrameWaits);
+            mStaleDeadlines = 0;
+        }
+        catch (const std::bad_alloc&)
+        {
+        }
+    }
+
+    void Scheduler::cancel(TaskId id)
+    {
+        remove(id);
+    }
+
+    bool Scheduler::isWaiting(const Waiter& waiter)
+    {
+        const Task* task = getTask(waiter.mTask);
+        return task != nullptr && task->mWaiting && task->mWait == waiter.mWait;
+    }
+
+    void Scheduler::wake(const Waiter& waiter)
+    {
+        Task* task = getTask(waiter.mTask);
+        if (task == nullptr || !task->mWaiting || task->mWait != waiter.mWait)
+            return;
+        task->mWaiting = false;
+        task->mSignal = nullptr;
+        mReady.push_back(waiter.mTask);
+    }
+
+    void Scheduler::signal(std::string_view name)
+    {
+        auto found = mSignals.find(name);
+        if (found == mSignals.end())
+            return;
+        const std::vector<Waiter> waiters = std::move(found->second);
+        mSignals.erase(found);
+        for (const Waiter& waiter : waiters)
+            wake(waiter);
+    }
+
+    std::size_t Scheduler::tick(double time)
+    {
+        mTime = time;
+        ++mFrame;
+        const auto wakeDeadline = [&](const Waiter& waiter) {
+            if (isWaiting(waiter))
+                wake(waiter);
+            else if (mStaleDeadlines > 0)
+                --mStaleDeadlines;
+        };
+        while (!mTimers.empty() && mTimers.top().mWhen <= mTime)
+        {
+            wakeDeadline(mTimers.top().mWaiter);
+            mTimers.pop();
+        }
+        while (!mFrameWaits.empty() && mFrameWaits.top().mWhen <= mFrame)
+        {
+            wakeDeadline(mFrameWaits.top().mWaiter);
+            mFrameWaits.pop();
+        }
+        // Tasks queued while ticking run on the next tick
+        std::size_t pending = mReady.size();
+        std::size_t resumed = 0;
+        if (pending == 0 || mBudget == 0)
+            return 0;
+        mState.withStack([&](Stack& stack) {
+            while (pending > 0 && resumed < mBudget)
+            {
+                const TaskId id = mReady.front();
+                mReady.pop_front();
+                --pending;
+                if (getTask(id) == nullptr)
+                    continue;
+                ++resumed;
+                resume(stack, id);
+            }
+        });
+        return resumed;
+    }
+
+    void Scheduler::resume(Stack& stack, TaskId id)
+    {
+        // Tasks can be spawned or cancelled while this one runs, so the Task is looked up again afterwards
+        const Task* current = getTask(id);
+        const bool recycle = current->mOwned && mRecycling;
+        const Coroutine coroutine = current->mCoroutine.pushTo(stack);
+        mRunning = id;
+        mRunningThread = stack.api().asThread(coroutine.getIndex());
+        mRunningWaits = false;
+        bool finished = false;
+        try
+        {
+            coroutine.resume();
+            finished = coroutine.getStatus() == CoroutineStatus::Finished;
+            if (finished && recycle)
+                coroutine.recycle();
+        }
+        catch (const std::exception& e)
+        {
+            mRunningThread = nullptr;
+            stack.pop();
+            remove(id);
+            if (!mErrorHandler)
+                throw;
+            mErrorHandler(id, e.what());
+            return;
+        }
+        mRunningThread = nullptr;
+        stack.pop();
+        Task* task = getTask(id);
+        if (task == nullptr)
+            return;
+        else if (finished)
+            remove(id);
+        else if (mRunningWaits)
+            task->mWaiting = true;
+        else
+            mReady.push_back(id);
+    }
+
+    Scheduler::Waiter Scheduler::beginWait(lua_State* state)
+    {
+        if (state != mRunningThread)
+        {
+            LuaApi api(*state);
+            api.pushCString("can only wait from inside a scheduled task");
+            api.error();
+        }
+        Task* task = getTask(mRunning);
+        return { mRunning, task == nullptr ? 0 : ++task->mWait };
+    }
+
+    int Scheduler::suspend(LuaApi& api)
+    {
+        mRunningWaits = true;
+        return api.yield(0);
+    }
+
+    // Queueing a wait allocates, and C++ exceptions must not unwind through Lua, so failures become Lua errors. Only
+    // once the wait is queued is the task marked as waiting, keeping it runnable if a script catches the error.
+    int Scheduler::sleep(lua_State* state)
+    {
+        LuaApi api(*state);
+        Scheduler& scheduler = getScheduler(api);
+        const double seconds = api.checkNumberFunctionArgument(1);
+        const Waiter waiter = scheduler.beginWait(state);
+        try
+        {
+            scheduler.mTimers.push({ scheduler.mTime + seconds, waiter });
+        }
+        catch (...)
+        {
+            detail::raiseFunctionError(state);
+        }
+        return scheduler.suspend(api);
+    }
+
+    int Scheduler::sleepUntil(lua_State* state)
+    {
+        LuaApi api(*state);
+        Scheduler& scheduler = getScheduler(api);
+        const double time = api.checkNumberFunctionArgument(1);
+        const Waiter waiter = scheduler.beginWait(state);
+        try
+        {
+            scheduler.mTimers.push({ time, waiter });
+        }
+        catch (...)
+        {
+            detail::raiseFunctionError(state);
+        }
+        return scheduler.suspend(api);
+    }
+
+    int Scheduler::waitFrames(lua_State* state)
+    {
+        LuaApi api(*state);
+        Scheduler& scheduler = getScheduler(api);
+        const lua_Integer count = std::max<lua_Integer>(api.checkIntegerFunctionArgument(1), 0);
+        const Waiter waiter = scheduler.beginWait(state);
+        try
+        {
+            scheduler.mFrameWaits.push({ scheduler.mFrame + static_cast<std::uint64_t>(count), waiter });
+        }
+        catch (...)
+        {
+            detail::raiseFunctionError(state);
+        }
+        return scheduler.suspend(api);
+    }
+
+    int Scheduler::waitUntilFrame(lua_State* state)
+    {
+        LuaApi api(*state);
+        Scheduler& scheduler = getScheduler(api);
+        const lua_Integer frame = std::max<lua_Integer>(api.checkIntegerFunctionArgument(1), 0);
+        const Waiter waiter = scheduler.beginWait(state);
+        try
+        {
+            scheduler.mFrameWaits.push({ static_cast<std::uint64_t>(frame), waiter });
+        }
+        catch (...)
+        {
+            detail::raiseFunctionError(state);
+        }
+        return scheduler.suspend(api);
+    }
+
+    int Scheduler::wait(lua_State* state)
+    {
+        LuaApi api(*state);
+        Scheduler& scheduler = getScheduler(api);
+        const std::string_view name = api.checkToStringFunctionArgument(1);
+        const Waiter waiter = scheduler.beginWait(state);
+        try
+        {
+            auto found = scheduler.mSignals.find(name);
+            if (found == scheduler.mSignals.end())
+                found = scheduler.mSignals.emplace(std::string(name), std::vector<Waiter>()).first;
+            found->second.push_back(waiter);
+            if (Task* task = scheduler.getTask(waiter.mTask))
+                task->mSignal = &found->first;
+        }
+        catch (...)
+        {
+            detail::raiseFunctionError(state);
+        }
+        return scheduler.suspend(api);
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef LATTICE_SCHEDULER_H
+#define LATTICE_SCHEDULER_H
+
+#include "reference.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct lua_State;
+
+namespace lat
+{
+    class Coroutine;
+    class FunctionView;
+    class LuaApi;
+    class Stack;
+    class State;
+    class TableView;
+
+    // Identifies a task for as long as it runs; ids of finished tasks are never reused
+    using TaskId = std::uint64_t;
+
+    // Runs script coroutines cooperatively on one State. Tasks wait by calling the functions installed by
+    // registerFunctions; a task that yields any other way is resumed again on the next tick. Each tick only touches
+    // tasks that are ready to run.
+    // The scheduler holds references into the State and must be destroyed first. Its registered functions raise an
+    // error once it has been.
+    class Scheduler
+    {
+        struct Task
+        {
+            CoroutineReference mCoroutine;
+            std::uint32_t mGeneration = 0;
+            // Incremented for every wait so stale wake-ups can be told apart
+            std::uint32_t mWait = 0;
+            bool mAlive = false;
+            bool mWaiting = false;
+            // Created by spawn, so nothing else can refer to the thread once it finishes
+            bool mOwned = false;
+            // The key in mSignals while waiting for a signal
+            const std::string* mSignal = nullptr;
+        };
+
+        struct Waiter
+        {
+            TaskId mTask;
+            std::uint32_t mWait;
+        };
+
+        template <class T>
+        struct Deadline
+        {
+            T mWhen;
+            Waiter mWaiter;
+
+            bool operator>(const Deadline& other) const { return mWhen > other.mWhen; }
+        };
+
+        template <class T>
+        using DeadlineQueue = std::priority_queue<Deadline<T>, std::vector<Deadline<T>>, std::greater<>>;
+
+        struct StringHash
+        {
+            using is_transparent = void;
+
+            std::size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+        };
+
+        const State& mState;
+        // User data holding a pointer to this scheduler for the registered functions, cleared on destruction
+        Reference mSelfReference;
+        Scheduler** mSelf = nullptr;
+        std::vector<Task> mTasks;
+        std::vector<std::uint32_t> mFreeTasks;
+        std::deque<TaskId> mReady;
+        DeadlineQueue<double> mTimers;
+        DeadlineQueue<std::uint64_t> mFrameWaits;
+        std::unordered_map<std::string, std::vector<Waiter>, StringHash, std::equal_to<>> mSignals;
+        std::function<void(TaskId, std::string_view)> mErrorHandler;
+        std::size_t mBudget = std::numeric_limits<std::size_t>::max();
+        std::size_t mTaskCount = 0;
+        // Deadlines left behind by cancelled tasks, dropped once they make up half of the queued ones
+        std::size_t mStaleDeadlines = 0;
+        double mTime = 0.;
+        std::uint64_t mFrame = 0;
+        TaskId mRunning = 0;
+        lua_State* mRunningThread = nullptr;
+        bool mRunningWaits = false;
+        bool mRecycling = false;
+
+        Scheduler(const Scheduler&) = delete;
+
+        Task* getTask(TaskId);
+        TaskId add(CoroutineReference&&, bool owned);
+        void remove(TaskId);
+        void pruneDeadlines();
+        bool isWaiting(const Waiter&);
+        void wake(const Waiter&);
+        void resume(Stack&, TaskId);
+
+        // Starts a wait for the task running on the given thread, raising a Lua error if there is none
+        Waiter beginWait(lua_State*);
+        // Yields the running task once its wait has been queued
+        int suspend(LuaApi&);
+
+        static int sleep(lua_State*);
+        static int sleepUntil(lua_State*);
+        static int waitFrames(lua_State*);
+        static int waitUntilFrame(lua_State*);
+        static int wait(lua_State*);
+
+    public:
+        explicit Scheduler(const State&);
+        ~Scheduler();
+
+        // Adds sleep(seconds), sleepUntil(time), waitFrames(count), waitUntilFrame(frame) and wait(signal) to the table.
+        // Calling them from a task suspends it until the condition is met.
+        void registerFunctions(const TableView&);
+
+        // The task is resumed on the next tick. With recycling enabled, threads created for functions are recycled once
+        // they finish.
+        TaskId spawn(const FunctionView&);
+        TaskId spawn(const Coroutine&);
+        // Also drops whatever the task was waiting for
+        void cancel(TaskId);
+        bool isAlive(TaskId) const;
+
+        // Wakes every task waiting on the signal; they are resumed on the next tick
+        void signal(std::string_view name);
+
+        // Advances the clock to time and the frame number by one, then resumes up to the budget of ready tasks.
+        // Tasks that are left over stay first in line for the next tick. Returns the number of resumed tasks.
+        std::size_t tick(double time);
+
+        // Hands threads created by spawn to the state's coroutine pool once they finish. Disabled by default: a script
+        // that kept its thread around (coroutine.running) would otherwise drive whichever task gets the thread next.
+        void setRecycling(bool enabled) { mRecycling = enabled; }
+        bool isRecycling() const { return mRecycling; }
+
+        void setResumeBudget(std::size_t budget) { mBudget = budget; }
+        std::size_t getResumeBudget() const { return mBudget; }
+
+        // Called with the error of a task that failed, after removing it. Without a handler tick rethrows the error.
+        void setErrorHandler(std::function<void(TaskId, std::string_view)> handler)
+        {
+            mErrorHandler = std::move(handler);
+        }
+
+        double getTime() const { return mTime; }
+        std::uint64_t getFrame() const { return mFrame; }
+        std::size_t getTaskCount() const { return mTaskCount; }
+    };
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <new>
 #include <stdexcept>
 
+#include "chunkcache.hpp"
+#include "coroutinepool.hpp"
 #include "exception.hpp"
 #include "function.hpp"
 #include "lua/api.hpp"
@@ -32,6 +34,17 @@ namespace
         throw std::runtime_error(fallback);
     }
 
+    [[noreturn]] void throwMemoryError(lat::LuaApi& lua)
+    {
+        if (lua.getType(-1) == lat::LuaType::String)
+        {
+            lat::MemoryError error(lua.toString(-1).data());
+            lua.pop(1);
+            throw error;
+        }
+        throw lat::MemoryError("out of memory");
+    }
+
     void checkProtectedCallStatus(lat::LuaApi& lua, lat::LuaStatus status)
     {
         switch (status)
@@ -39,7 +52,7 @@ namespace
             case lat::LuaStatus::ErrorHandlingError:
                 throwLuaError(lua, "error handler failed");
             case lat::LuaStatus::MemoryError:
-                throwLuaError(lua, "out of memory");
+                throwMemoryError(lua);
             case lat::LuaStatus::RuntimeError:
                 throwLuaError(lua, "error");
             case lat::LuaStatus::Ok:
@@ -79,32 +92,21 @@ namespace
         api.error();
     }
 
-    int invokeFunction(lua_State* state)
+    constexpr const char* functionDataMetatable = "lat.FunctionData";
+    // Inline function data is prefixed by its destructor, keeping the function itself pointer aligned
+    constexpr std::size_t functionDataHeaderSize = sizeof(lat::detail::FunctionDataDestructor);
+
+    int destroyFunctionData(lua_State* state)
     {
         lat::LuaApi api(*state);
-        try
+        auto header = static_cast<lat::detail::FunctionDataDestructor*>(api.asUserData(1));
+        if (header != nullptr && *header != nullptr)
         {
-            lat::Stack stack(state);
-            api.pushUpValue(1);
-            auto function = stack.getObject(-1).as<std::function<int(lat::Stack&)>*>();
-            api.pop(1);
-            return (*function)(stack);
-        }
-        catch (const lat::ArgumentTypeError& e)
-        {
-            // Free up what space we can, but keep the bad index so the error message can show its type
-            if (api.getStackSize() > e.getIndex())
-                api.setStackSize(e.getIndex());
-            api.raiseArgumentTypeError(e.getIndex(), e.getType().data());
-        }
-        catch (const std::exception& e)
-        {
-            raiseLuaError(api, e.what());
-        }
-        catch (...)
-        {
-            raiseLuaError(api, "unknown error");
+            lat::detail::FunctionDataDestructor destructor = *header;
+            *header = nullptr;
+            destructor(header + 1);
         }
+        return 0;
     }
 
     int loadFunction(lat::LuaApi lua, std::string_view script, const char* name)
@@ -118,7 +120,7 @@ namespace
             case lat::LuaStatus::SyntaxError:
                 throwLuaError(lua, "syntax error");
             case lat::LuaStatus::MemoryError:
-                throwLuaError(lua, "out of memory");
+                throwMemoryError(lua);
             case lat::LuaStatus::Ok:
                 return lua.getStackSize();
             default:
@@ -129,6 +131,54 @@ namespace
 
 namespace lat
 {
+    void* detail::getFunctionData(lua_State* state)
+    {
+        void* data = LuaApi(*state).asUserData(lua_upvalueindex(1));
+        return static_cast<std::byte*>(data) + functionDataHeaderSize;
+    }
+
+    void detail::raiseFunctionError(lua_State* state)
+    {
+        LuaApi api(*state);
+        try
+        {
+            throw;
+        }
+        catch (const ArgumentTypeError& e)
+        {
+            // Free up what space we can, but keep the bad index so the error message can show its type
+            if (api.getStackSize() > e.getIndex())
+                api.setStackSize(e.getIndex());
+            api.raiseArgumentTypeError(e.getIndex(), e.getType().data());
+        }
+        catch (const std::exception& e)
+        {
+            raiseLuaError(api, e.what());
+        }
+        catch (...)
+        {
+            raiseLuaError(api, "unknown error");
+        }
+    }
+
+    static_assert(detail::NilTag == LUA_TNIL && detail::BooleanTag == LUA_TBOOLEAN
+        && detail::LightUserDataTag == LUA_TLIGHTUSERDATA && detail::NumberTag == LUA_TNUMBER
+        && detail::StringTag == LUA_TSTRING && detail::TableTag == LUA_TTABLE && detail::FunctionTag == LUA_TFUNCTION
+        && detail::UserDataTag == LUA_TUSERDATA && detail::ThreadTag == LUA_TTHREAD);
+
+    std::uint64_t detail::getTypeSignature(const Stack& stack, int count)
+    {
+        LuaApi api = stack.api();
+        count = std::min(count, maxTypeSignatureSize);
+        std::uint64_t signature = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const auto tag = static_cast<std::uint64_t>(api.getType(i + 1));
+            signature |= tag << (i * typeTagBits);
+        }
+        return signature;
+    }
+
     Stack::Stack(lua_State* state)
         : mState(state)
     {
@@ -155,6 +205,35 @@ namespace lat
         checkProtectedCallStatus(lua, status);
     }
 
+    int Stack::resumeCoroutine(int index, int argCount)
+    {
+        LuaApi lua = api();
+        lua_State* state = lua.asThread(index);
+        if (state == mState)
+            throw std::runtime_error("cannot resume a running coroutine");
+        LuaApi thread(*state);
+        ::ensure(thread, static_cast<std::uint16_t>(argCount));
+        lua.moveValuesTo(thread, argCount);
+        const std::optional<MemoryOwner> owner = State::getThreadOwner(*this, index);
+        const MemoryOwner previousOwner = owner ? State::swapMemoryOwner(*this, *owner) : defaultMemoryOwner;
+        lua_State* previous = State::swapResumedThread(*this, state);
+        LuaStatus status = thread.resumeThread(argCount);
+        State::swapResumedThread(*this, previous);
+        if (owner)
+            State::swapMemoryOwner(*this, previousOwner);
+        if (status != LuaStatus::Ok && status != LuaStatus::Yield)
+        {
+            // The error value is left on top of the dead thread
+            ::ensure(lua, 1);
+            thread.moveValuesTo(lua, 1);
+            checkProtectedCallStatus(lua, status);
+        }
+        const int resCount = thread.getStackSize();
+        ::ensure(lua, static_cast<std::uint16_t>(resCount));
+        thread.moveValuesTo(lua, resCount);
+        return resCount;
+    }
+
     void Stack::call(FunctionRef<void(Stack&)> function)
     {
         protectedCall(
@@ -212,9 +291,7 @@ namespace lat
 
     void* Stack::getAllocatorData() const
     {
-        void* data;
-        api().getAllocator(&data);
-        return data;
+        return State::getAllocatorData(*this);
     }
 
     int Stack::makeAbsolute(int index) const
@@ -373,7 +450,16 @@ namespace lat
     {
         if (script.starts_with(LUA_SIGNATURE[0]))
             throw std::invalid_argument("argument cannot be bytecode");
-        return FunctionView(*this, loadFunction(api(), script, name));
+        ChunkCache* cache = State::getChunkCache(*this);
+        if (cache == nullptr)
+            return FunctionView(*this, loadFunction(api(), script, name));
+        const std::string_view chunkName = name == nullptr ? "" : name;
+        // Each hit loads a new closure so callers can't see each other's environment
+        if (const std::string* cached = cache->find(script, chunkName))
+            return FunctionView(*this, loadFunction(api(), *cached, name));
+        FunctionView function(*this, loadFunction(api(), script, name));
+        cache->insert(script, chunkName, std::string(function.dump().get()));
+        return function;
     }
 
     FunctionView Stack::pushFunction(const ByteCode& code, const char* name)
@@ -381,13 +467,159 @@ namespace lat
         return FunctionView(*this, loadFunction(api(), code.get(), name));
     }
 
-    FunctionView Stack::pushFunctionImpl(std::function<int(Stack&)> function)
+    Coroutine Stack::pushCoroutine(const FunctionView& function)
+    {
+        LuaApi lua = api();
+        ::ensure(lua, 2);
+        CoroutinePool* pool = State::getCoroutinePool(*this);
+        if (pool == nullptr || !pool->pop(*this))
+            lua.createThread();
+        const int index = lua.getStackSize();
+        LuaApi thread(*lua.asThread(index));
+        if (pool != nullptr)
+        {
+            // Recycled threads get the globals a new thread would have
+            lua.pushCopy(LUA_GLOBALSINDEX);
+            lua.moveValuesTo(thread, 1);
+            thread.replace(LUA_GLOBALSINDEX);
+        }
+        ObjectView(function).pushTo(*this);
+        lua.moveValuesTo(thread, 1);
+        State::inheritThreadOwner(*this, index);
+        return Coroutine(*this, index);
+    }
+
+    int Stack::callOwnedFunction(lua_State* state)
+    {
+        LuaApi api(*state);
+        Stack stack(state);
+        const int argCount = api.getStackSize();
+        api.pushUpValue(1);
+        api.insert(1);
+        const auto owner = static_cast<MemoryOwner>(api.asInteger(lua_upvalueindex(2)));
+        const MemoryOwner previous = State::swapMemoryOwner(stack, owner);
+        // Protected, so the owner is restored before the error moves on
+        const LuaStatus status = api.protectedCall(argCount);
+        State::swapMemoryOwner(stack, previous);
+        if (status != LuaStatus::Ok)
+            api.error();
+        return api.getStackSize();
+    }
+
+    FunctionView Stack::pushOwnedFunction(const FunctionView& function, MemoryOwner owner)
     {
-        State::getUserTypeRegistry(*this).pushValue(*this, std::move(function));
-        api().pushFunction(&invokeFunction, 1);
+        LuaApi lua = api();
+        ::ensure(lua, 2);
+        ObjectView(function).pushTo(*this);
+        lua.pushInteger(static_cast<lua_Integer>(owner));
+        lua.pushFunction(&callOwnedFunction, 2);
         return getObject(-1).asFunction();
     }
 
+    bool Stack::recycleCoroutine(int index)
+    {
+        CoroutinePool* pool = State::getCoroutinePool(*this);
+        if (pool == nullptr || pool->isFull())
+            return false;
+        pool->push(store(index));
+        return true;
+    }
+
+    FunctionView Stack::pushFunctionImpl(lua_CFunction invoker, std::size_t size,
+        detail::FunctionDataDestructor destructor, FunctionRef<void(void*)> constructor)
+    {
+        LuaApi lua = api();
+        ::ensure(lua, 3);
+        // Everything that can raise a Lua error happens before construction so the function cannot leak
+        if (destructor != nullptr && lua.createOrPushMetatable(functionDataMetatable))
+        {
+            lua.pushFunction(&destroyFunctionData);
+            lua.setTableValue(-2, meta::gc.data());
+        }
+        auto header
+            = static_cast<detail::FunctionDataDestructor*>(lua.createUserData(functionDataHeaderSize + size));
+        *header = nullptr;
+        try
+        {
+            constructor(header + 1);
+        }
+        catch (...)
+        {
+            lua.pop(destructor == nullptr ? 1 : 2);
+            throw;
+        }
+        if (destructor != nullptr)
+        {
+            *header = destructor;
+            lua.insert(-2);
+            lua.setMetatable(-2);
+        }
+        lua.pushFunction(invoker, 1);
+        return getObject(-1).asFunction();
+    }
+
+    FunctionView Stack::pushFunctionImpl(lua_CFunction function)
+    {
+        LuaApi lua = api();
+        ::ensure(lua, 1);
+        lua.pushFunction(function);
+        return FunctionView(*this, lua.getStackSize());
+    }
+
+    bool Stack::pushFfiLibrary()
+    {
+#ifdef LAT_LUAJIT
+        LuaApi lua = api();
+        ::ensure(lua, 3);
+        // Looked up the way require would, so this works without the package library
+        auto pushLibrary = [&](const char* table) {
+            lua.pushTableValue(LUA_REGISTRYINDEX, table);
+            if (lua.isTable(-1))
+                lua.pushTableValue(-1, "ffi");
+            else
+                lua.pushNil();
+            lua.remove(-2);
+        };
+        pushLibrary("_LOADED");
+        if (lua.isNil(-1))
+        {
+            lua.pop(1);
+            pushLibrary("_PRELOAD");
+            if (lua.isFunction(-1))
+            {
+                lua.pushCString("ffi");
+                lua.call(1, 1);
+                // Opening the library again would replace its type state
+                lua.pushTableValue(LUA_REGISTRYINDEX, "_LOADED");
+                if (lua.isTable(-1))
+                {
+                    lua.pushCopy(-2);
+                    lua.setTableValue(-2, "ffi");
+                }
+                lua.pop(1);
+            }
+        }
+        if (lua.isTable(-1))
+            return true;
+        lua.pop(1);
+#endif
+        return false;
+    }
+
+    FunctionView Stack::pushFfiFunction(std::string_view type, void* address, lua_CFunction fallback)
+    {
+        if (!pushFfiLibrary())
+            return pushFunctionImpl(fallback);
+        LuaApi lua = api();
+        ::ensure(lua, 3);
+        lua.pushTableValue(-1, "cast");
+        lua.remove(-2);
+        lua.pushString(type);
+        lua.pushLightUserData(address);
+        lua.call(2, 1);
+        return FunctionView(*this, lua.getStackSize());
+    }
+
     ObjectView Stack::pushLightUserData(void* value)
     {
         return ObjectView(*this, ::push(api(), &LuaApi::pushLightUserData, value));
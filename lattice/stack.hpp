@@ -2,12 +2,18 @@
 #define LATTICE_STACK_H
 
 #include "convert.hpp"
+#include "coroutine.hpp"
+#include "ffi.hpp"
 #include "forwardstack.hpp"
 #include "function.hpp"
 #include "overload.hpp"
 #include "table.hpp"
 #include "usertype.hpp"
 
+#include <memory>
+#include <new>
+#include <type_traits>
+
 namespace lat
 {
     template <class Path>
@@ -50,15 +56,48 @@ namespace lat
         return getObject(-1);
     }
 
+    template <auto Invoke, class T>
+    FunctionView Stack::pushFunctionImpl(T&& function)
+    {
+        using F = std::decay_t<T>;
+        detail::FunctionDataDestructor destructor = nullptr;
+        if constexpr (!std::is_trivially_destructible_v<F>)
+            destructor = [](void* pointer) { std::destroy_at(static_cast<F*>(pointer)); };
+        return pushFunctionImpl(&detail::invokeFunctionData<F, Invoke>, sizeof(F), destructor,
+            [&](void* pointer) { new (pointer) F(std::forward<T>(function)); });
+    }
+
     template <class T>
     FunctionView Stack::pushFunction(T&& function)
     {
+        using F = std::decay_t<T>;
         if constexpr (detail::isOverload<std::remove_reference_t<T>>)
-            return pushFunctionImpl(std::forward<T>(function).toFunction());
+        {
+            auto overloads = std::forward<T>(function).toFunction();
+            using O = decltype(overloads);
+            return pushFunctionImpl<&detail::invokeStackFunction<O>>(std::move(overloads));
+        }
         else if constexpr (detail::StringViewConstructible<T>)
             return pushFunction(std::string_view(function));
+        else if constexpr (detail::isBound<F>)
+            return pushFunction<F::function>();
+        else if constexpr (detail::isFfiBound<F>)
+        {
+            using Signature = typename F::Signature;
+            static const std::string type = Signature::getType();
+            return pushFfiFunction(type, reinterpret_cast<void*>(&Signature::template invoke<F::function>),
+                &detail::invokeStaticFunction<F::function>);
+        }
+        else if constexpr (!detail::InlineFunction<F>)
+            return pushFunction(std::function(std::forward<T>(function)));
         else
-            return pushFunctionImpl(detail::wrapFunction(std::function(function)));
+            return pushFunctionImpl<&detail::SignatureOf<F>::template invoke<F>>(std::forward<T>(function));
+    }
+
+    template <auto Function>
+    FunctionView Stack::pushFunction()
+    {
+        return pushFunctionImpl(&detail::invokeStaticFunction<Function>);
     }
 
     template <class T, class... Bases>
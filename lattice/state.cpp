@@ -2,12 +2,19 @@
 
 #include <lua.hpp>
 
+#include <algorithm>
+#include <csignal>
 #include <format>
 #include <optional>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
 
+#include "callqueue.hpp"
+#include "chunkcache.hpp"
+#include "coroutinepool.hpp"
 #include "lua/api.hpp"
+#include "memoryattribution.hpp"
 #include "reference.hpp"
 #include "stack.hpp"
 #include "userdata.hpp"
@@ -16,13 +23,70 @@ namespace lat
 {
     static_assert(std::is_same_v<lua_Alloc, Allocator<void>>);
 
-    struct MainStack
+    namespace
     {
-        static constexpr auto globalName = "lat.Main";
+        void updateDebugHook(const MainStack&, LuaApi);
+    }
 
+    struct MainStack
+    {
         Stack mStack;
+        // The state's own allocator; MainStack takes its place so the allocator's user data can point back to us
+        Allocator<void> mAllocator;
+        void* mAllocatorData;
         std::optional<FunctionRef<void(Stack&, lua_Debug&)>> mDebugHook;
+        LuaHookMask mDebugHookMask = LuaHookMask::None;
+        int mDebugHookCount = 0;
+        int mPumpInterval = 0;
+        // The count hook is shared, so each interval keeps track of the instructions it still has to wait for
+        int mDebugHookCountLeft = 0;
+        int mPumpCountLeft = 0;
+        // PUC Lua keeps hooks per thread, so the thread resumed from C++ is armed alongside the main thread
+        lua_State* mResumedThread = nullptr;
+        CallQueue mCallQueue;
+        MemoryLimits mMemoryLimits;
+        std::size_t mMemoryUsed = 0;
+        bool mSoftLimitReached = false;
+        // Waiting for the count hook to run mOnSoftLimit and collect garbage
+        bool mSoftLimitPending = false;
+        std::optional<FunctionRef<void(Stack&)>> mSampler;
+        // Set from signal handlers
+        volatile std::sig_atomic_t mSamplePending = 0;
+        std::unique_ptr<MemoryAttribution> mAttribution;
+        MemoryOwner mMemoryOwner = defaultMemoryOwner;
+        // Registry reference to a table with weak keys mapping threads to their owners, created when first needed
+        int mThreadOwners = LUA_NOREF;
         UserTypeRegistry mTypeRegistry;
+        ChunkCache mChunkCache;
+        CoroutinePool mCoroutinePool;
+
+        static void* allocate(void* userData, void* pointer, std::size_t oldSize, std::size_t newSize)
+        {
+            auto main = static_cast<MainStack*>(userData);
+            const std::size_t used = main->mMemoryUsed - (pointer == nullptr ? 0 : oldSize) + newSize;
+            if (newSize > oldSize && used > main->mMemoryLimits.mHard)
+                return nullptr;
+            void* result = main->mAllocator(main->mAllocatorData, pointer, oldSize, newSize);
+            if (result != nullptr || newSize == 0)
+            {
+                if (main->mAttribution)
+                    main->mAttribution->record(pointer, oldSize, result, newSize, main->mMemoryOwner);
+                main->mMemoryUsed = used;
+                if (used <= main->mMemoryLimits.mSoft)
+                    main->mSoftLimitReached = false;
+                else if (!main->mSoftLimitReached)
+                    main->reachSoftLimit();
+            }
+            return result;
+        }
+
+        // Allocating is no place to run Lua code, so that waits for the next instruction
+        void reachSoftLimit()
+        {
+            mSoftLimitReached = true;
+            mSoftLimitPending = true;
+            updateDebugHook(*this, mStack.api());
+        }
 
         [[noreturn]] static int defaultIndex(lua_State* state)
         {
@@ -47,11 +111,17 @@ namespace lat
         MainStack(lua_State* state)
             : mStack(state)
         {
+            LuaApi lua = mStack.api();
+            mAllocator = lua.getAllocator(&mAllocatorData);
+            // Every thread of a state shares its allocator, making this reachable from coroutines without touching
+            // the stack or any (script visible) table
+            lua.setAllocator(&allocate, this);
+            mMemoryUsed = static_cast<std::size_t>(lua.getMemoryUseKiB()) * 1024 + lua.getMemoryUseRemainderB();
             mStack.protectedCall(
                 [](lua_State* state) {
                     LuaApi api(*state);
                     auto main = static_cast<MainStack*>(api.asUserData(-1));
-                    api.setGlobalValue(globalName);
+                    api.pop(1);
                     {
                         api.pushFunction(&defaultIndex);
                         int ref = api.createReferenceIn(LUA_REGISTRYINDEX);
@@ -67,8 +137,53 @@ namespace lat
                 this);
         }
 
-        void callDebugHook(lua_Debug* activationRecord)
+        bool hasUserCountHook() const
+        {
+            return (static_cast<int>(mDebugHookMask) & LUA_MASKCOUNT) != 0 && mDebugHookCount > 0;
+        }
+
+        void callDebugHook(lua_State* state, lua_Debug* activationRecord)
         {
+            if (activationRecord->event == LUA_HOOKCOUNT)
+            {
+                // The hook may have been armed for fewer instructions than either interval, for example by a sample
+                const int elapsed = LuaApi(*state).getDebugHookInterval();
+                bool userDue = false;
+                if (hasUserCountHook())
+                {
+                    mDebugHookCountLeft -= elapsed;
+                    userDue = mDebugHookCountLeft <= 0;
+                    if (userDue)
+                        mDebugHookCountLeft = mDebugHookCount;
+                }
+                bool pumpDue = false;
+                if (mPumpInterval > 0)
+                {
+                    mPumpCountLeft -= elapsed;
+                    pumpDue = mPumpCountLeft <= 0;
+                    if (pumpDue)
+                        mPumpCountLeft = mPumpInterval;
+                }
+                // Cleared before rearming so a request arriving meanwhile keeps the hook armed
+                const bool sample = mSamplePending != 0;
+                const bool softLimit = mSoftLimitPending;
+                mSamplePending = 0;
+                mSoftLimitPending = false;
+                updateDebugHook(*this, mStack.api());
+                Stack stack(state);
+                if (sample && mSampler)
+                    (*mSampler)(stack);
+                if (softLimit)
+                {
+                    if (mMemoryLimits.mOnSoftLimit)
+                        mMemoryLimits.mOnSoftLimit(stack, mMemoryUsed);
+                    stack.collectGarbage();
+                }
+                if (pumpDue)
+                    mCallQueue.drainFromHook(stack);
+                if (!userDue)
+                    return;
+            }
             if (mDebugHook)
                 (*mDebugHook)(mStack, *activationRecord);
         }
@@ -76,18 +191,34 @@ namespace lat
         ~MainStack()
         {
             mTypeRegistry.clear();
+            mCoroutinePool.clear();
+            // Finalizers may still allocate
+            mMemoryLimits = {};
+            LuaApi api = mStack.api();
+            // Finalizers can no longer reach us, so don't let them run into the hook
+            api.setDebugHook(nullptr, LuaHookMask::None, 0);
+            // LuaJIT only releases its internal allocator's memory if it is still the state's allocator
+            api.setAllocator(mAllocator, mAllocatorData);
             lua_close(mStack.mState);
         }
     };
 
     namespace
     {
-        MainStack* getMainStack(LuaApi& api)
+        MainStack* getMainStack(const LuaApi& api)
+        {
+            void* main = nullptr;
+            if (api.getAllocator(&main) != &MainStack::allocate)
+                return nullptr;
+            return static_cast<MainStack*>(main);
+        }
+
+        MainStack& getValidMainStack(const LuaApi& api)
         {
-            api.pushGlobal(MainStack::globalName);
-            auto main = static_cast<MainStack*>(api.asUserData(-1));
-            api.pop(1);
-            return main;
+            MainStack* main = getMainStack(api);
+            if (main == nullptr)
+                throw std::logic_error("invalid state");
+            return *main;
         }
 
         void callDebugHook(lua_State* state, lua_Debug* activationRecord)
@@ -101,7 +232,7 @@ namespace lat
             }
             try
             {
-                main->callDebugHook(activationRecord);
+                main->callDebugHook(state, activationRecord);
                 return;
             }
             catch (const std::exception& e)
@@ -116,6 +247,46 @@ namespace lat
             }
             api.error();
         }
+
+        void armDebugHook(const MainStack& main, const LuaApi& api, int mask, int count)
+        {
+            lua_Hook hook = mask == 0 ? nullptr : callDebugHook;
+            // Setting the hook restarts its count, so leave a hook that is already armed alone. A signal may interrupt
+            // the interpreter counting down, which then overwrites the count it was armed with, so always arm a single
+            // instruction again.
+            if (count != 1 && api.getDebugHook() == hook && static_cast<int>(api.getDebugHookMask()) == mask
+                && api.getDebugHookInterval() == count)
+                return;
+            api.setDebugHook(hook, static_cast<LuaHookMask>(mask), count);
+            // A sample requested by a signal handler interrupting us must not be overwritten
+            if (count != 1 && main.mSamplePending)
+                api.setDebugHook(callDebugHook, static_cast<LuaHookMask>(mask | LUA_MASKCOUNT), 1);
+        }
+
+        // Combines the user's hook with pumping the call queue, sampling and the soft memory limit. The count hook is
+        // armed for whichever comes first; callDebugHook only forwards count events once the user's interval elapsed.
+        void updateDebugHook(const MainStack& main, LuaApi api)
+        {
+            int mask = static_cast<int>(main.mDebugHookMask);
+            int count = main.mDebugHookCount;
+            if (main.hasUserCountHook())
+                count = main.mDebugHookCountLeft;
+            if (main.mPumpInterval > 0)
+            {
+                count = main.hasUserCountHook() ? std::min(count, main.mPumpCountLeft) : main.mPumpCountLeft;
+                mask |= LUA_MASKCOUNT;
+            }
+            if (main.mSoftLimitPending || main.mSamplePending)
+            {
+                mask |= LUA_MASKCOUNT;
+                count = 1;
+            }
+            armDebugHook(main, api, mask, count);
+#ifndef LAT_LUAJIT
+            if (main.mResumedThread != nullptr)
+                armDebugHook(main, LuaApi(*main.mResumedThread), mask, count);
+#endif
+        }
     }
 
     State::State()
@@ -128,22 +299,43 @@ namespace lat
         mState = std::make_unique<MainStack>(lua_newstate(allocator, userData));
     }
 
+    State::State(MemoryLimits limits)
+        : State()
+    {
+        setMemoryLimits(std::move(limits));
+    }
+
     State::~State() = default;
 
     Stack& State::getMain(Stack& stack)
     {
-        stack.ensure(1);
-        LuaApi api = stack.api();
-        MainStack* main = getMainStack(api);
-        return main->mStack;
+        return getValidMainStack(stack.api()).mStack;
+    }
+
+    void* State::getAllocatorData(const Stack& stack)
+    {
+        return getValidMainStack(stack.api()).mAllocatorData;
+    }
+
+    ChunkCache* State::getChunkCache(const Stack& stack)
+    {
+        MainStack* main = getMainStack(stack.api());
+        if (main == nullptr || !main->mChunkCache.isEnabled())
+            return nullptr;
+        return &main->mChunkCache;
+    }
+
+    CoroutinePool* State::getCoroutinePool(const Stack& stack)
+    {
+        MainStack* main = getMainStack(stack.api());
+        if (main == nullptr || !main->mCoroutinePool.isEnabled())
+            return nullptr;
+        return &main->mCoroutinePool;
     }
 
     UserTypeRegistry& State::getUserTypeRegistry(Stack& stack)
     {
-        stack.ensure(1);
-        LuaApi api = stack.api();
-        MainStack* main = getMainStack(api);
-        return main->mTypeRegistry;
+        return getValidMainStack(stack.api()).mTypeRegistry;
     }
 
     void State::withStack(FunctionRef<void(Stack&)> function) const
@@ -154,13 +346,38 @@ namespace lat
     void State::setDebugHook(FunctionRef<void(Stack&, lua_Debug&)> hook, LuaHookMask mask, int count) const
     {
         mState->mDebugHook = hook;
-        mState->mStack.api().setDebugHook(callDebugHook, mask, count);
+        mState->mDebugHookMask = mask;
+        mState->mDebugHookCount = count;
+        mState->mDebugHookCountLeft = count;
+        updateDebugHook(*mState, mState->mStack.api());
     }
 
     void State::disableDebugHook() const
     {
         mState->mDebugHook.reset();
-        mState->mStack.api().setDebugHook(nullptr, LuaHookMask::None, 0);
+        mState->mDebugHookMask = LuaHookMask::None;
+        mState->mDebugHookCount = 0;
+        mState->mDebugHookCountLeft = 0;
+        updateDebugHook(*mState, mState->mStack.api());
+    }
+
+    CallQueue& State::getCallQueue() const
+    {
+        return mState->mCallQueue;
+    }
+
+    std::size_t State::pump() const
+    {
+        std::size_t count = 0;
+        withStack([&](Stack& stack) { count = mState->mCallQueue.drain(stack); });
+        return count;
+    }
+
+    void State::setHookPumpInterval(int count) const
+    {
+        mState->mPumpInterval = count;
+        mState->mPumpCountLeft = count;
+        updateDebugHook(*mState, mState->mStack.api());
     }
 
     void State::loadLibraries(std::span<const Library> libraries) const
@@ -238,4 +455,152 @@ namespace lat
         bytes += api.getMemoryUseRemainderB();
         return bytes;
     }
+
+    void State::setMemoryLimits(MemoryLimits limits) const
+    {
+        mState->mMemoryLimits = std::move(limits);
+        mState->mSoftLimitPending = false;
+        if (mState->mMemoryUsed > mState->mMemoryLimits.mSoft)
+            mState->reachSoftLimit();
+        else
+        {
+            mState->mSoftLimitReached = false;
+            updateDebugHook(*mState, mState->mStack.api());
+        }
+    }
+
+    void State::setMemoryAttribution(bool enabled) const
+    {
+        if (!enabled)
+            mState->mAttribution.reset();
+        else if (!mState->mAttribution)
+            mState->mAttribution = std::make_unique<MemoryAttribution>(mState->mMemoryUsed);
+    }
+
+    MemoryOwnerStats State::getMemoryOwnerStats(MemoryOwner owner) const
+    {
+        if (!mState->mAttribution)
+            return { .mOwner = owner };
+        return mState->mAttribution->getStats(owner);
+    }
+
+    std::vector<MemoryOwnerStats> State::getMemoryOwnerStats() const
+    {
+        if (!mState->mAttribution)
+            return {};
+        return mState->mAttribution->getStats();
+    }
+
+    MemoryOwner State::swapMemoryOwner(Stack& stack, MemoryOwner owner)
+    {
+        return std::exchange(getValidMainStack(stack.api()).mMemoryOwner, owner);
+    }
+
+    lua_State* State::swapResumedThread(Stack& stack, lua_State* thread)
+    {
+        MainStack& main = getValidMainStack(stack.api());
+        lua_State* previous = std::exchange(main.mResumedThread, thread);
+        updateDebugHook(main, main.mStack.api());
+        return previous;
+    }
+
+    void State::setThreadOwner(Stack& stack, int index, MemoryOwner owner)
+    {
+        MainStack& main = getValidMainStack(stack.api());
+        index = stack.makeAbsolute(index);
+        stack.ensure(4);
+        LuaApi api = stack.api();
+        if (main.mThreadOwners == LUA_NOREF)
+        {
+            if (owner == defaultMemoryOwner)
+                return;
+            api.createTable();
+            api.createTable(0, 1);
+            api.pushCString("k");
+            api.setTableValue(-2, "__mode");
+            api.setMetatable(-2);
+            main.mThreadOwners = api.createReferenceIn(LUA_REGISTRYINDEX);
+        }
+        api.pushRawTableValue(LUA_REGISTRYINDEX, main.mThreadOwners);
+        api.pushCopy(index);
+        if (owner == defaultMemoryOwner)
+            api.pushNil();
+        else
+            api.pushInteger(static_cast<lua_Integer>(owner));
+        api.setRawTableEntry(-3);
+        api.pop(1);
+    }
+
+    void State::inheritThreadOwner(Stack& stack, int index)
+    {
+        MainStack* main = getMainStack(stack.api());
+        if (main != nullptr && main->mAttribution)
+            setThreadOwner(stack, index, main->mMemoryOwner);
+        else if (main != nullptr && main->mThreadOwners != LUA_NOREF)
+            setThreadOwner(stack, index, defaultMemoryOwner);
+    }
+
+    std::optional<MemoryOwner> State::getThreadOwner(Stack& stack, int index)
+    {
+        MainStack* main = getMainStack(stack.api());
+        if (main == nullptr || !main->mAttribution || main->mThreadOwners == LUA_NOREF)
+            return {};
+        index = stack.makeAbsolute(index);
+        stack.ensure(2);
+        LuaApi api = stack.api();
+        api.pushRawTableValue(LUA_REGISTRYINDEX, main->mThreadOwners);
+        api.pushCopy(index);
+        api.pushRawTableValue(-2);
+        std::optional<MemoryOwner> owner;
+        if (api.isNumber(-1))
+            owner = static_cast<MemoryOwner>(api.asInteger(-1));
+        api.pop(2);
+        return owner;
+    }
+
+    void State::setSampler(std::optional<FunctionRef<void(Stack&)>> sampler) const
+    {
+        mState->mSampler = sampler;
+        if (!sampler)
+        {
+            mState->mSamplePending = 0;
+            updateDebugHook(*mState, mState->mStack.api());
+        }
+    }
+
+    void State::requestSample() const noexcept
+    {
+        mState->mSamplePending = 1;
+        updateDebugHook(*mState, mState->mStack.api());
+    }
+
+    void State::setChunkCacheCapacity(std::size_t capacity) const
+    {
+        mState->mChunkCache.setCapacity(capacity);
+    }
+
+    ChunkCacheStats State::getChunkCacheStats() const
+    {
+        return mState->mChunkCache.getStats();
+    }
+
+    void State::clearChunkCache() const
+    {
+        mState->mChunkCache.clear();
+    }
+
+    void State::setCoroutinePoolCapacity(std::size_t capacity) const
+    {
+        mState->mCoroutinePool.setCapacity(capacity);
+    }
+
+    CoroutinePoolStats State::getCoroutinePoolStats() const
+    {
+        return mState->mCoroutinePool.getStats();
+    }
+
+    void State::clearCoroutinePool() const
+    {
+        mState->mCoroutinePool.clear();
+    }
 }
@@ -4,18 +4,29 @@
 #include "functionref.hpp"
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <span>
+#include <vector>
 
 struct lua_Debug;
+struct lua_State;
 
 namespace lat
 {
     template <class UserData>
     using Allocator = void* (*)(UserData*, void*, std::size_t, std::size_t);
 
+    class CallQueue;
+    class ChunkCache;
+    class CoroutinePool;
     enum class LuaHookMask : int;
     struct MainStack;
+    class MemoryOwnerScope;
+    class Profiler;
     class Stack;
     class UserTypeRegistry;
 
@@ -35,18 +46,83 @@ namespace lat
         StringBuffer,
     };
 
+    struct ChunkCacheStats
+    {
+        std::size_t mHits;
+        std::size_t mMisses;
+        std::size_t mSize;
+        std::size_t mCapacity;
+    };
+
+    struct CoroutinePoolStats
+    {
+        // Threads handed out from the pool
+        std::size_t mReused;
+        // Threads created because the pool was empty
+        std::size_t mCreated;
+        std::size_t mSize;
+        std::size_t mCapacity;
+    };
+
+    struct MemoryLimits
+    {
+        // Allocations that would exceed it fail, raising a memory error in Lua and MemoryError in C++
+        std::size_t mHard = std::numeric_limits<std::size_t>::max();
+        // Once it is exceeded, mOnSoftLimit is called with the bytes in use at the next instruction (a safe point)
+        // before a full garbage collection runs. It is called again after usage has dropped back below the limit.
+        // PUC Lua keeps hooks per thread, so only the main thread and coroutines resumed from C++ (Coroutine, Scheduler)
+        // reach that point right away. A coroutine resumed from Lua (coroutine.resume or coroutine.wrap) defers it until
+        // control returns to one of those threads.
+        std::size_t mSoft = std::numeric_limits<std::size_t>::max();
+        std::function<void(Stack&, std::size_t)> mOnSoftLimit;
+    };
+
+    // Tags the code allocating memory, such as one script out of many
+    using MemoryOwner = std::uint32_t;
+    constexpr inline MemoryOwner defaultMemoryOwner = 0;
+
+    struct MemoryOwnerStats
+    {
+        MemoryOwner mOwner;
+        std::size_t mLiveBytes;
+        // Counting every (re)allocation, even if the memory has been freed since
+        std::size_t mAllocations;
+        std::size_t mAllocatedBytes;
+    };
+
     // Owning lua_State wrapper.
     class State
     {
         std::unique_ptr<MainStack> mState;
 
+        friend class Coroutine;
+        friend class MemoryOwnerScope;
+        friend class Profiler;
         friend class Stack;
 
         static Stack& getMain(Stack&);
+        static void* getAllocatorData(const Stack&);
+        static ChunkCache* getChunkCache(const Stack&);
+        static CoroutinePool* getCoroutinePool(const Stack&);
+        static MemoryOwner swapMemoryOwner(Stack&, MemoryOwner);
+        // Lets the state's hooks reach a thread resumed from C++, returning the thread resumed before it
+        static lua_State* swapResumedThread(Stack&, lua_State*);
+        // Owners of threads are kept in a weak table, so they go away with the thread
+        static void setThreadOwner(Stack&, int index, MemoryOwner);
+        // Charges a new thread to the current owner, clearing the owner a recycled thread had
+        static void inheritThreadOwner(Stack&, int index);
+        // The thread's owner, if attribution is enabled and it has one
+        static std::optional<MemoryOwner> getThreadOwner(Stack&, int index);
+
+        // The sampler is called from the debug hook with the running thread at the first instruction after a request
+        void setSampler(std::optional<FunctionRef<void(Stack&)>>) const;
+        // Async-signal-safe
+        void requestSample() const noexcept;
 
     public:
         State();
         State(Allocator<void>, void*);
+        explicit State(MemoryLimits);
 
         template <class UserData>
         State(Allocator<UserData> allocator, UserData* userData)
@@ -58,15 +134,73 @@ namespace lat
 
         void withStack(FunctionRef<void(Stack&)>) const;
 
+        // Count events are only passed on once count instructions ran, even if lattice uses the count hook in between.
+        // Doing so restarts Lua's count, so such an interval may run a little longer.
         void setDebugHook(FunctionRef<void(Stack&, lua_Debug&)> hook, LuaHookMask mask, int count = 0) const;
         void disableDebugHook() const;
 
+        // Other threads may post to the queue for as long as the state exists
+        CallQueue& getCallQueue() const;
+        // Runs the calls posted so far, returning how many ran
+        std::size_t pump() const;
+        // Also pumps every count instructions while scripts run, sharing the count hook with setDebugHook. A count of 0
+        // (the default) only pumps when asked to. Errors of calls pumped this way are handled as by
+        // CallQueue::drainFromHook.
+        // The hook does not reach all code: PUC Lua keeps hooks per thread, so coroutines created before the interval
+        // was set only pump while resumed from C++ (Coroutine, Scheduler), not from Lua (coroutine.resume or
+        // coroutine.wrap). LuaJIT never runs hooks inside compiled traces, so a loop that stays on trace does not pump.
+        void setHookPumpInterval(int count) const;
+
         void loadLibraries(std::span<const Library> = {}) const;
 
         std::size_t getMemoryUsed() const;
+        // Applies to any allocator. Memory allocated before the limits were set counts towards them.
+        void setMemoryLimits(MemoryLimits) const;
+
+        // Charges every allocation to the current owner, see MemoryOwnerScope. Memory freed or reallocated is credited
+        // to the owner it was last allocated for. Disabling attribution drops the statistics.
+        void setMemoryAttribution(bool enabled) const;
+        MemoryOwnerStats getMemoryOwnerStats(MemoryOwner) const;
+        // Every owner that allocated since attribution was enabled, ordered by owner
+        std::vector<MemoryOwnerStats> getMemoryOwnerStats() const;
+
+        // Keeps the bytecode of up to capacity functions loaded from source, so pushing or executing the same source with
+        // the same name again skips compiling it. Hits still load a new function, with its own environment. A capacity
+        // of 0 (the default) disables caching.
+        void setChunkCacheCapacity(std::size_t capacity) const;
+        ChunkCacheStats getChunkCacheStats() const;
+        void clearChunkCache() const;
+
+        // Keeps up to capacity finished threads passed to Coroutine::recycle, so Stack::pushCoroutine can hand them out
+        // again instead of creating new ones. A capacity of 0 (the default) disables pooling.
+        // Lua code may still hold a recycled thread, for example from coroutine.running, and would then resume
+        // whatever runs on it next. Only recycle threads that scripts cannot have kept.
+        void setCoroutinePoolCapacity(std::size_t capacity) const;
+        CoroutinePoolStats getCoroutinePoolStats() const;
+        void clearCoroutinePool() const;
 
         static UserTypeRegistry& getUserTypeRegistry(Stack&);
     };
+
+    // Sets the owner charged for the state's allocations while it is in scope, for example around running a script's
+    // chunk or calling its callbacks. Code that runs later carries its owner with it through Stack::pushOwnedFunction
+    // and Coroutine::setMemoryOwner; coroutines and Scheduler tasks created in scope keep its owner.
+    class MemoryOwnerScope
+    {
+        Stack& mStack;
+        MemoryOwner mPrevious;
+
+        MemoryOwnerScope(const MemoryOwnerScope&) = delete;
+
+    public:
+        MemoryOwnerScope(Stack& stack, MemoryOwner owner)
+            : mStack(stack)
+            , mPrevious(State::swapMemoryOwner(stack, owner))
+        {
+        }
+
+        ~MemoryOwnerScope() { State::swapMemoryOwner(mStack, mPrevious); }
+    };
 }
 
 #endif
@@ -0,0 +1,146 @@
+#include "statepool.hpp"
+
+#include "poolallocator.hpp"
+#include "stack.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace lat
+{
+    namespace
+    {
+        std::unique_ptr<State> buildState(const StateRecipe& recipe, std::vector<ByteCode>& compiled)
+        {
+            auto state = recipe.mAllocator ? std::make_unique<State>(&PoolAllocator::allocate, recipe.mAllocator)
+                                           : std::make_unique<State>();
+            if (recipe.mLibraries)
+                state->loadLibraries(*recipe.mLibraries);
+            state->withStack([&](Stack& stack) {
+                if (recipe.mSetUp)
+                    recipe.mSetUp(stack);
+                for (std::size_t i = 0; i < recipe.mChunks.size(); ++i)
+                {
+                    const StateRecipe::Chunk& chunk = recipe.mChunks[i];
+                    const char* name = chunk.mName.empty() ? nullptr : chunk.mName.c_str();
+                    if (i < compiled.size())
+                        stack.pushFunction(compiled[i], name)();
+                    else
+                    {
+                        FunctionView function = stack.pushFunction(chunk.mSource, name);
+                        compiled.push_back(function.dump());
+                        function();
+                    }
+                    stack.pop();
+                }
+            });
+            return state;
+        }
+    }
+
+    StatePool::Handle::Handle(Handle&& other) noexcept
+        : mPool(std::exchange(other.mPool, nullptr))
+        , mIndex(other.mIndex)
+    {
+    }
+
+    StatePool::Handle& StatePool::Handle::operator=(Handle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            mPool = std::exchange(other.mPool, nullptr);
+            mIndex = other.mIndex;
+        }
+        return *this;
+    }
+
+    StatePool::Handle::~Handle()
+    {
+        reset();
+    }
+
+    void StatePool::Handle::reset()
+    {
+        if (mPool != nullptr)
+            std::exchange(mPool, nullptr)->checkin(mIndex);
+    }
+
+    StatePool::StatePool(const StateRecipe& recipe, std::size_t size, bool affinity)
+        : mAffinity(affinity)
+    {
+        if (size == 0)
+            throw std::invalid_argument("a state pool needs at least one state");
+        if (recipe.mAllocator && !recipe.mAllocator->hasThreadCache())
+            throw std::invalid_argument("a state pool can only share an allocator with a thread cache");
+        std::vector<ByteCode> compiled;
+        compiled.reserve(recipe.mChunks.size());
+        mSlots.resize(size);
+        mFree.reserve(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            mSlots[i].mState = buildState(recipe, compiled);
+            // Hand out the lowest indices first
+            mFree.push_back(size - i - 1);
+        }
+    }
+
+    std::size_t StatePool::take()
+    {
+        ++mCheckouts;
+        if (mAffinity)
+        {
+            const auto found = mLastUsed.find(std::this_thread::get_id());
+            if (found != mLastUsed.end() && !mSlots[found->second].mCheckedOut)
+            {
+                ++mAffinityHits;
+                const std::size_t index = found->second;
+                mFree.erase(std::find(mFree.begin(), mFree.end(), index));
+                mSlots[index].mCheckedOut = true;
+                return index;
+            }
+        }
+        const std::size_t index = mFree.back();
+        mFree.pop_back();
+        mSlots[index].mCheckedOut = true;
+        if (mAffinity)
+            mLastUsed[std::this_thread::get_id()] = index;
+        return index;
+    }
+
+    void StatePool::checkin(std::size_t index)
+    {
+        {
+            std::lock_guard lock(mMutex);
+            mSlots[index].mCheckedOut = false;
+            mFree.push_back(index);
+        }
+        mCheckedIn.notify_one();
+    }
+
+    StatePool::Handle StatePool::checkout()
+    {
+        std::unique_lock lock(mMutex);
+        if (mFree.empty())
+        {
+            ++mWaits;
+            mCheckedIn.wait(lock, [&] { return !mFree.empty(); });
+        }
+        return Handle(*this, take());
+    }
+
+    std::optional<StatePool::Handle> StatePool::tryCheckout()
+    {
+        std::lock_guard lock(mMutex);
+        if (mFree.empty())
+            return {};
+        return Handle(*this, take());
+    }
+
+    StatePoolStats StatePool::getStats() const
+    {
+        std::lock_guard lock(mMutex);
+        return { mSlots.size(), mFree.size(), mCheckouts, mWaits, mAffinityHits };
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef LATTICE_STATEPOOL_H
+#define LATTICE_STATEPOOL_H
+
+#include "state.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lat
+{
+    class PoolAllocator;
+    class Stack;
+
+    // How every state of a StatePool is initialized, in member order
+    struct StateRecipe
+    {
+        struct Chunk
+        {
+            std::string mSource;
+            std::string mName;
+        };
+
+        // Passed to State::loadLibraries if set, so an empty list loads every library
+        std::optional<std::vector<Library>> mLibraries;
+        // Declares usertypes, functions and anything else that is not a script
+        std::function<void(Stack&)> mSetUp;
+        // Executed in order. Each chunk is compiled once and loaded as bytecode by the other states.
+        std::vector<Chunk> mChunks;
+        // Shared by every state if set. It needs the thread cache and must outlive the pool.
+        PoolAllocator* mAllocator = nullptr;
+    };
+
+    struct StatePoolStats
+    {
+        std::size_t mSize;
+        std::size_t mAvailable;
+        std::size_t mCheckouts;
+        // Checkouts that had to wait for a state to be checked in
+        std::size_t mWaits;
+        // Checkouts that got the state the calling thread used last
+        std::size_t mAffinityHits;
+    };
+
+    // A fixed set of identically initialized states for use from multiple threads. A state is only ever checked out to
+    // one thread at a time. The pool must outlive its handles.
+    class StatePool
+    {
+        struct Slot
+        {
+            std::unique_ptr<State> mState;
+            bool mCheckedOut = false;
+        };
+
+        std::vector<Slot> mSlots;
+        std::vector<std::size_t> mFree;
+        std::unordered_map<std::thread::id, std::size_t> mLastUsed;
+        mutable std::mutex mMutex;
+        std::condition_variable mCheckedIn;
+        bool mAffinity;
+        std::size_t mCheckouts = 0;
+        std::size_t mWaits = 0;
+        std::size_t mAffinityHits = 0;
+
+        StatePool(const StatePool&) = delete;
+
+        std::size_t take();
+        void checkin(std::size_t);
+
+    public:
+        // Checks its state back in on destruction
+        class Handle
+        {
+            StatePool* mPool;
+            std::size_t mIndex;
+
+            Handle(StatePool& pool, std::size_t index)
+                : mPool(&pool)
+                , mIndex(index)
+            {
+            }
+
+            friend class StatePool;
+
+        public:
+            Handle(Handle&&) noexcept;
+            Handle& operator=(Handle&&) noexcept;
+            ~Handle();
+
+            void reset();
+
+            State& get() const { return *mPool->mSlots[mIndex].mState; }
+            State& operator*() const { return get(); }
+            State* operator->() const { return &get(); }
+
+            // Stable for the lifetime of the pool
+            std::size_t getIndex() const { return mIndex; }
+        };
+
+        // Builds every state up front. With affinity, a thread gets the state it used last if that one is available.
+        StatePool(const StateRecipe&, std::size_t size, bool affinity = false);
+
+        // Waits until a state is available
+        Handle checkout();
+        std::optional<Handle> tryCheckout();
+
+        std::size_t size() const { return mSlots.size(); }
+        StatePoolStats getStats() const;
+    };
+}
+
+#endif
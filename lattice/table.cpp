@@ -68,6 +68,16 @@ namespace lat
         mStack.api().setRawTableValue(mIndex, index);
     }
 
+    void TableView::setRawValue(int index) const
+    {
+        mStack.api().setRawTableValue(mIndex, index);
+    }
+
+    void TableView::setRawEntry() const
+    {
+        mStack.api().setRawTableEntry(mIndex);
+    }
+
     void TableLikeViewBase::cleanUp(int prev) const
     {
         const int diff = mStack.getTop() - prev;
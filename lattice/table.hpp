@@ -6,7 +6,10 @@
 #include "object.hpp"
 #include "reference.hpp"
 
+#include <array>
 #include <cstddef>
+#include <iterator>
+#include <ranges>
 #include <optional>
 #include <stdexcept>
 #include <string_view>
@@ -97,7 +100,10 @@ namespace lat
                         return {};
                     }
                 }
-                return detail::pullFromStack<Value>(mStack, table);
+                int keep = top;
+                Value value = detail::pullFromStack<Value>(mStack, table, keep);
+                cleanUp(keep);
+                return value;
             }
             catch (...)
             {
@@ -130,6 +136,8 @@ namespace lat
                         ++i;
                     }(),
                     ...);
+                // Pop the last intermediate table
+                cleanUp(top);
             }
             catch (...)
             {
@@ -186,12 +194,40 @@ namespace lat
 
         using TableLikeViewBase::TableLikeViewBase;
 
+        void setRawValue(int) const;
+        void setRawEntry() const;
+
     public:
         TableReference store() const;
 
         ObjectView getRaw(int) const;
         void setRaw(int, const ObjectView&) const;
 
+        // Sets t[index] = value without invoking metamethods
+        template <class T>
+        void setRaw(int index, T&& value) const
+        {
+            pushSingleObject(std::forward<T>(value));
+            setRawValue(index);
+        }
+
+        // Sets t[key] = value without invoking metamethods
+        template <class K, class V>
+        void setRawEntry(K&& key, V&& value) const
+        {
+            pushSingleObject(std::forward<K>(key));
+            try
+            {
+                pushSingleObject(std::forward<V>(value));
+            }
+            catch (...)
+            {
+                mStack.pop();
+                throw;
+            }
+            setRawEntry();
+        }
+
         std::size_t size() const;
 
         std::optional<std::pair<ObjectView, ObjectView>> next(const ObjectView&) const;
@@ -312,6 +348,106 @@ namespace lat
         return view.asTableLike();
     }
 
+    template <class T>
+        requires detail::ArrayContainer<std::remove_cvref_t<T>>
+    inline void pushValue(Stack& stack, T&& value)
+    {
+        using Value = std::ranges::range_value_t<std::remove_cvref_t<T>>;
+        TableView table = stack.pushArray(static_cast<int>(std::size(value)));
+        int i = 1;
+        for (auto&& element : value)
+        {
+            if constexpr (std::is_same_v<Value, std::remove_cvref_t<decltype(element)>>)
+                table.setRaw(i++, element);
+            else // std::vector<bool>
+                table.setRaw(i++, static_cast<Value>(element));
+        }
+    }
+
+    template <class T>
+        requires detail::MapContainer<std::remove_cvref_t<T>>
+    inline void pushValue(Stack& stack, T&& value)
+    {
+        TableView table = stack.pushTable(static_cast<int>(value.size()));
+        for (const auto& [key, element] : value)
+            table.setRawEntry(key, element);
+    }
+
+    namespace detail
+    {
+        // Elements are converted one at a time so they can't refer to the stack
+        template <class T>
+        concept ContainerElement = SingleStackPull<T> && !keepsStackValue<T>;
+    }
+
+    template <class T, class Allocator>
+        requires detail::ContainerElement<T>
+    inline std::vector<T, Allocator> getValue(ObjectView view, Type<std::vector<T, Allocator>>)
+    {
+        const TableView table = view.asTable();
+        const std::size_t size = table.size();
+        std::vector<T, Allocator> values;
+        values.reserve(size);
+        for (std::size_t i = 1; i <= size; ++i)
+        {
+            ObjectView element = table.getRaw(static_cast<int>(i));
+            try
+            {
+                values.emplace_back(element.as<T>());
+            }
+            catch (...)
+            {
+                view.getStack().pop();
+                throw;
+            }
+            view.getStack().pop();
+        }
+        return values;
+    }
+
+    template <class T, std::size_t N>
+        requires detail::ContainerElement<T>
+    inline std::array<T, N> getValue(ObjectView view, Type<std::array<T, N>>)
+    {
+        const TableView table = view.asTable();
+        const auto get = [&](std::size_t i) {
+            ObjectView element = table.getRaw(static_cast<int>(i + 1));
+            try
+            {
+                T value = element.as<T>();
+                view.getStack().pop();
+                return value;
+            }
+            catch (...)
+            {
+                view.getStack().pop();
+                throw;
+            }
+        };
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            return std::array<T, N>{ get(I)... };
+        }(std::make_index_sequence<N>{});
+    }
+
+    template <detail::MapContainer T>
+        requires detail::ContainerElement<typename T::key_type> && detail::ContainerElement<typename T::mapped_type>
+    inline T getValue(ObjectView view, Type<T>)
+    {
+        using K = typename T::key_type;
+        using V = typename T::mapped_type;
+        T values;
+        view.asTable().forEach([&](ObjectView key, ObjectView value) { values.emplace(key.as<K>(), value.as<V>()); });
+        return values;
+    }
+
+    template <class T>
+        requires(detail::isVector<T> || detail::isStdArray<T> || detail::MapContainer<T>)
+        && detail::GetFromViewSpecialized<T>
+    inline bool isValue(const Stack& stack, int& pos, Type<T>)
+    {
+        return stack.isTable(pos++);
+    }
+
     namespace detail
     {
         template <>
@@ -0,0 +1,288 @@
+#include "tracediagnostics.hpp"
+
+#include <lua.hpp>
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <tuple>
+
+#include "function.hpp"
+#include "stack.hpp"
+#include "table.hpp"
+
+namespace lat
+{
+    namespace
+    {
+#ifdef LAT_LUAJIT
+        constexpr std::string_view diagnosticsScript = R"(
+            local registry, globals = ...
+            local loaded, preload = registry._LOADED, registry._PRELOAD
+            -- Library functions are captured up front so scripts replacing the globals later do not affect them
+            local base, string = loaded and loaded._G or {}, loaded and loaded.string
+            local ipairs, pairs, pcall, rawget = base.ipairs, base.pairs, base.pcall, base.rawget
+            local setmetatable, tostring, type = base.setmetatable, base.tostring, base.type
+            if not (ipairs and pairs and pcall and rawget and setmetatable and tostring and type and string) then
+                return nil, "trace diagnostics require the base and string libraries"
+            end
+            local jit = loaded.jit
+            if not jit or not preload or not preload["jit.util"] then
+                return nil, "trace diagnostics require the JIT library"
+            end
+            local util = loaded["jit.util"] or preload["jit.util"]("jit.util")
+            local traceErrors = {}
+            if type(globals.require) == "function" then
+                local ok, vmdef = pcall(globals.require, "jit.vmdef")
+                if ok and type(vmdef) == "table" then
+                    traceErrors = vmdef.traceerr
+                end
+            end
+
+            local names = setmetatable({}, { __mode = "k" })
+            local unnamed = setmetatable({}, { __mode = "k" })
+            local function addName(value, name)
+                if type(value) == "function" and names[value] == nil then
+                    names[value] = name
+                end
+            end
+            local function addTable(t, prefix)
+                for key, value in pairs(t) do
+                    if type(key) == "string" then
+                        addName(value, prefix .. key)
+                    end
+                end
+            end
+            local function scan()
+                addTable(globals, "")
+                for key, value in pairs(globals) do
+                    if type(key) == "string" and type(value) == "table" and value ~= globals then
+                        addTable(value, key .. ".")
+                    end
+                end
+                for _, meta in pairs(registry) do
+                    local typeName = type(meta) == "table" and rawget(meta, "__type")
+                    if type(typeName) == "string" then
+                        for _, key in ipairs({ "lat.props", "lat.get", "lat.set" }) do
+                            local t = rawget(meta, key)
+                            if type(t) == "table" then
+                                addTable(t, typeName .. ".")
+                            end
+                        end
+                        addTable(meta, typeName .. ".")
+                    end
+                end
+            end
+            -- Rescans once per unknown function, as functions may be bound after starting
+            local function nameOf(fn)
+                local name = names[fn]
+                if name == nil and not unnamed[fn] then
+                    scan()
+                    name = names[fn]
+                    unnamed[fn] = name == nil
+                end
+                return name or tostring(fn)
+            end
+            local function location(func, pc)
+                local info = func and util.funcinfo(func, pc)
+                return info and info.loc or "?"
+            end
+
+            local issues, traces = {}, 0
+            local recordFunc, recordPc
+            local function record(where, reason, fn)
+                local key = where .. "\0" .. reason .. "\0" .. fn
+                local issue = issues[key]
+                if not issue then
+                    issue = { where = where, reason = reason, fn = fn, count = 0 }
+                    issues[key] = issue
+                end
+                issue.count = issue.count + 1
+            end
+            -- Only Lua bytecode has a position
+            local function onRecord(tr, func, pc)
+                if pc >= 0 then
+                    recordFunc, recordPc = func, pc
+                end
+            end
+            local function onTrace(what, tr, func, pc, code, info)
+                if what == "abort" then
+                    local format = traceErrors[code]
+                    local fn = ""
+                    if type(info) == "function" then
+                        fn = nameOf(info)
+                        info = nil
+                    end
+                    local reason
+                    if format then
+                        reason = info ~= nil and string.format(format, info) or (string.gsub(format, " ?%%[sd]", ""))
+                    else
+                        reason = "trace error " .. tostring(code) .. (info ~= nil and ": " .. tostring(info) or "")
+                    end
+                    local where = location(func, pc)
+                    if where == "?" then
+                        where = location(recordFunc, recordPc)
+                    end
+                    record(where, reason, fn)
+                elseif what == "stop" then
+                    traces = traces + 1
+                    local trace = util.traceinfo(tr)
+                    -- A stitched trace stops at the C function it could not record, which the next trace resumes after
+                    if trace and trace.linktype == "stitch" then
+                        local fn = type(func) == "function" and nameOf(func) or ""
+                        record(location(recordFunc, recordPc), "stitched around a C function", fn)
+                    end
+                end
+            end
+
+            local control = {}
+            function control.start()
+                jit.attach(onRecord, "record")
+                jit.attach(onTrace, "trace")
+            end
+            function control.stop()
+                jit.attach(onTrace)
+                jit.attach(onRecord)
+            end
+            function control.clear()
+                issues, traces = {}, 0
+            end
+            function control.traces()
+                return traces
+            end
+            function control.issues()
+                local list = {}
+                for _, issue in pairs(issues) do
+                    list[#list + 1] = issue
+                end
+                return list
+            end
+            return control
+        )";
+#endif
+    }
+
+    TraceDiagnostics::TraceDiagnostics(const State& state)
+        : mState(state)
+    {
+#ifdef LAT_LUAJIT
+        mState.withStack([&](Stack& stack) {
+            FunctionView init = stack.pushFunction(diagnosticsScript, "=tracediagnostics");
+            auto [control, error] = init.invoke<std::tuple<ObjectView, ObjectView>>(
+                stack.getObject(LUA_REGISTRYINDEX), stack.getObject(LUA_GLOBALSINDEX));
+            if (control.isNil())
+                throw std::runtime_error(error.as<std::string>());
+            mControl = control.asTable().store();
+        });
+#else
+        throw std::runtime_error("trace diagnostics require LuaJIT");
+#endif
+    }
+
+    TraceDiagnostics::~TraceDiagnostics()
+    {
+        stop();
+    }
+
+    void TraceDiagnostics::call(const char* function) const
+    {
+        mControl.onStack([&](Stack&, TableView control) {
+            FunctionView f = control[function];
+            f();
+        });
+    }
+
+    void TraceDiagnostics::start()
+    {
+        if (mRunning)
+            return;
+        call("start");
+        mRunning = true;
+    }
+
+    void TraceDiagnostics::stop()
+    {
+        if (!mRunning)
+            return;
+        call("stop");
+        mRunning = false;
+    }
+
+    void TraceDiagnostics::clear()
+    {
+        call("clear");
+    }
+
+    std::size_t TraceDiagnostics::getTraceCount() const
+    {
+        std::size_t count = 0;
+        mControl.onStack([&](Stack&, TableView control) {
+            FunctionView traces = control["traces"];
+            count = traces.invoke<std::size_t>();
+        });
+        return count;
+    }
+
+    std::vector<TraceIssue> TraceDiagnostics::getIssues() const
+    {
+        std::vector<TraceIssue> issues;
+        mControl.onStack([&](Stack&, TableView control) {
+            FunctionView collect = control["issues"];
+            TableView list = collect.invoke<TableView>();
+            const std::size_t size = list.size();
+            issues.reserve(size);
+            for (std::size_t i = 1; i <= size; ++i)
+            {
+                issues.push_back({
+                    .mLocation = list.get<std::string>(i, "where"),
+                    .mReason = list.get<std::string>(i, "reason"),
+                    .mFunction = list.get<std::string>(i, "fn"),
+                    .mCount = list.get<std::size_t>(i, "count"),
+                });
+            }
+        });
+        std::sort(issues.begin(), issues.end(), [](const TraceIssue& l, const TraceIssue& r) {
+            if (l.mCount != r.mCount)
+                return l.mCount > r.mCount;
+            return std::tie(l.mLocation, l.mReason, l.mFunction) < std::tie(r.mLocation, r.mReason, r.mFunction);
+        });
+        return issues;
+    }
+
+    std::vector<TraceCause> TraceDiagnostics::getCauses() const
+    {
+        std::vector<TraceCause> causes;
+        for (const TraceIssue& issue : getIssues())
+        {
+            auto found = std::find_if(causes.begin(), causes.end(),
+                [&](const TraceCause& cause) { return cause.mReason == issue.mReason; });
+            if (found == causes.end())
+                causes.push_back({ issue.mReason, issue.mCount });
+            else
+                found->mCount += issue.mCount;
+        }
+        std::stable_sort(causes.begin(), causes.end(),
+            [](const TraceCause& l, const TraceCause& r) { return l.mCount > r.mCount; });
+        return causes;
+    }
+
+    std::string TraceDiagnostics::getReport() const
+    {
+        std::string report = std::format("{} traces compiled\n", getTraceCount());
+        const std::vector<TraceIssue> issues = getIssues();
+        if (issues.empty())
+            return report;
+        report += "causes:\n";
+        for (const TraceCause& cause : getCauses())
+            report += std::format("  {} x{}\n", cause.mReason, cause.mCount);
+        report += "locations:\n";
+        for (const TraceIssue& issue : issues)
+        {
+            report += std::format("  {}: {}", issue.mLocation, issue.mReason);
+            if (!issue.mFunction.empty())
+                report += std::format(" [{}]", issue.mFunction);
+            report += std::format(" x{}\n", issue.mCount);
+        }
+        return report;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef LATTICE_TRACEDIAGNOSTICS_H
+#define LATTICE_TRACEDIAGNOSTICS_H
+
+#include "reference.hpp"
+#include "state.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lat
+{
+    struct TraceIssue
+    {
+        // Where the trace gave up, as "chunk:line"
+        std::string mLocation;
+        std::string mReason;
+        // The bound function the trace failed on, if any
+        std::string mFunction;
+        std::size_t mCount = 0;
+    };
+
+    struct TraceCause
+    {
+        std::string mReason;
+        std::size_t mCount = 0;
+    };
+
+    // Watches LuaJIT's trace compiler (jit.attach) while scripts run and collects the traces that were aborted or
+    // stitched around a C function, which leaves the code around the call interpreted. Function values are named after
+    // the globals, modules and user types they are registered under. Requires LuaJIT with the JIT library loaded;
+    // otherwise the constructor throws. Abort reasons are only spelled out if jit.vmdef can be required.
+    class TraceDiagnostics
+    {
+        const State& mState;
+        TableReference mControl;
+        bool mRunning = false;
+
+        TraceDiagnostics(const TraceDiagnostics&) = delete;
+
+        void call(const char* function) const;
+
+    public:
+        explicit TraceDiagnostics(const State&);
+        ~TraceDiagnostics();
+
+        void start();
+        void stop();
+        bool isRunning() const { return mRunning; }
+
+        void clear();
+        // Traces compiled successfully since the last clear
+        std::size_t getTraceCount() const;
+
+        // Most frequent first
+        std::vector<TraceIssue> getIssues() const;
+        std::vector<TraceCause> getCauses() const;
+        // A human-readable summary of both
+        std::string getReport() const;
+    };
+}
+
+#endif
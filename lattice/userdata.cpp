@@ -8,8 +8,13 @@
 #include "table.hpp"
 #include "usertype.hpp"
 
-#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <format>
+#include <new>
 #include <stdexcept>
+#include <string>
 
 namespace lat
 {
@@ -45,31 +50,20 @@ namespace lat
             api.error();
         }
 
-        detail::TypeCaster isSameType(Stack& stack, LuaApi& api,
-            const std::vector<std::tuple<std::type_index, detail::TypeCaster>>& derived,
-            const std::unordered_map<std::type_index, UserTypeData>& mMetatables)
-        {
-            for (const auto& [index, caster] : derived)
-            {
-                const auto found = mMetatables.find(index);
-                if (found == mMetatables.end())
-                    continue;
-                found->second.mMetatable.pushTo(stack);
-                const bool same = api.equal(-1, -3);
-                api.pop(1);
-                if (same)
-                    return caster;
-                detail::TypeCaster c = isSameType(stack, api, found->second.mDerived, mMetatables);
-                if (c != nullptr)
-                    return c;
-            }
-            return nullptr;
-        }
+        // Marks user data laid out by a UserTypeRegistry ("LU")
+        constexpr std::uint16_t userDataTag = 0x4c55;
+
+        std::atomic<detail::TypeId> typeCounter = 0;
+    }
+
+    detail::TypeId detail::nextTypeId()
+    {
+        return typeCounter++;
     }
 
     void UserTypeRegistry::clear()
     {
-        mMetatables.clear();
+        mTypes.clear();
         mDefaultIndex.reset();
         mDefaultNewIndex.reset();
     }
@@ -77,50 +71,62 @@ namespace lat
     void UserTypeRegistry::destroyUserData(ObjectView view, Destructor consumer)
     {
         std::span<std::byte> data = view.asUserData();
-        if (data.size() < pointerSize)
+        if (data.size() < headerSize)
             throw std::invalid_argument("invalid user data");
-        else if (data.size() == pointerSize)
-        {
-            // "light" user data; pointer only
-            return;
-        }
-        void* pointer = nullptr;
-        std::memcpy(&pointer, data.data(), pointerSize);
-        if (pointer == nullptr)
+        auto header = std::launder(reinterpret_cast<detail::UserDataHeader*>(data.data()));
+        constexpr std::uint16_t live = detail::OwnedUserData | detail::LiveUserData;
+        if ((header->mFlags & live) != live)
             return; // nothing to destroy
-        consumer(pointer);
-        pointer = nullptr;
-        std::memcpy(data.data(), &pointer, pointerSize);
+        consumer(getObject(*header));
+        header->mFlags = static_cast<std::uint16_t>(header->mFlags & ~detail::LiveUserData);
     }
 
-    std::span<std::byte> UserTypeRegistry::pushUserData(
-        Stack& stack, std::size_t size, const void* pointer, std::type_index type, UserDataDestructor destructor)
+    detail::UserDataHeader& UserTypeRegistry::pushUserData(
+        Stack& stack, std::size_t size, detail::TypeId type, UserDataDestructor destructor, std::uint16_t flags)
     {
         const TableReference& ref = getUserTypeData(stack, type, destructor).mMetatable;
         TableView metatable = ref.pushTo(stack);
         std::span<std::byte> data = stack.pushUserData(size);
-        std::memcpy(data.data(), &pointer, pointerSize);
+        auto header = new (data.data()) detail::UserDataHeader{ type, userDataTag, flags };
         stack.getObject(-1).setMetatable(metatable);
         stack.remove(-2);
-        return data;
+        return *header;
     }
 
-    void UserTypeRegistry::pushUserData(Stack& stack, std::size_t size, std::size_t align, const std::type_info& type,
-        UserDataDestructor destructor, FunctionRef<void*(void*)> constructor)
+    void UserTypeRegistry::pushUserData(
+        Stack& stack, const void* pointer, detail::TypeId type, UserDataDestructor destructor)
     {
-        // object + padding to ensure alignment
-        const std::size_t dataSize = size + align - 1;
-        // Push a user type with the correct metatable. We init to nullptr because construction might throw
-        std::span<std::byte> data = pushUserData(stack, pointerSize + dataSize, nullptr, type, destructor);
-        void* pointer = data.data() + pointerSize;
-        std::size_t alignSize = dataSize;
-        pointer = std::align(align, size, pointer, alignSize);
+        detail::UserDataHeader& header
+            = pushUserData(stack, headerSize + pointerSize, type, destructor, detail::IndirectUserData);
+        new (&header + 1) void*(const_cast<void*>(pointer));
+    }
+
+    void UserTypeRegistry::pushUserData(Stack& stack, std::size_t size, std::size_t align, detail::TypeId type,
+        const std::type_info& info, UserDataDestructor destructor, FunctionRef<void*(void*)> constructor)
+    {
+        // Lua aligns user data for pointers, which is enough to store most objects right after the header
+        const bool inlined = align <= alignof(void*);
+        // Otherwise they're stored after a pointer to them, plus padding to ensure alignment
+        const std::size_t dataSize = inlined ? size : pointerSize + size + align - 1;
+        const auto flags = static_cast<std::uint16_t>(
+            inlined ? detail::OwnedUserData : detail::OwnedUserData | detail::IndirectUserData);
+        detail::UserDataHeader& header = pushUserData(stack, headerSize + dataSize, type, destructor, flags);
+        void* pointer = &header + 1;
+        if (!inlined)
+        {
+            std::size_t alignSize = size + align - 1;
+            pointer = static_cast<std::byte*>(pointer) + pointerSize;
+            pointer = std::align(align, size, pointer, alignSize);
+        }
         try
         {
             if (pointer == nullptr)
-                throw std::runtime_error(std::string("failed to align object of type ") + type.name());
+                throw std::runtime_error(std::string("failed to align object of type ") + info.name());
             pointer = constructor(pointer);
-            std::memcpy(data.data(), &pointer, pointerSize);
+            if (!inlined)
+                new (&header + 1) void*(pointer);
+            // Not destroyed unless construction succeeded
+            header.mFlags = static_cast<std::uint16_t>(header.mFlags | detail::LiveUserData);
         }
         catch (...)
         {
@@ -129,83 +135,130 @@ namespace lat
         }
     }
 
-    UserTypeData& UserTypeRegistry::getUserTypeData(Stack& stack, std::type_index type, UserDataDestructor destructor)
+    UserTypeData& UserTypeRegistry::getUserTypeData(Stack& stack, detail::TypeId type, UserDataDestructor destructor)
     {
-        auto found = mMetatables.find(type);
-        if (found == mMetatables.end())
+        if (type >= mTypes.size())
+            mTypes.resize(type + 1);
+        std::unique_ptr<UserTypeData>& data = mTypes[type];
+        if (!data)
         {
             TableView table = stack.pushTable();
             stack.pushLightUserData(reinterpret_cast<void*>(destructor));
             stack.api().pushFunction(&defaultDestructor, 1);
             table[meta::gc] = stack.getObject(-1);
-            found = mMetatables.emplace(type, table.store()).first;
+            data = std::make_unique<UserTypeData>(table.store());
+            data->mMetatableAddress = stack.api().asPointer(table.getIndex());
             stack.pop(2);
         }
-        return found->second;
+        return *data;
     }
 
-    bool UserTypeRegistry::matches(Stack& stack, int index, std::type_index type) const
+    detail::UserDataHeader* UserTypeRegistry::getHeader(Stack& stack, int index) const
     {
-        if (!stack.isUserData(index) || stack.isLightUserData(index))
-            return false;
-        const auto found = mMetatables.find(type);
-        if (found == mMetatables.end())
-            return false;
-        stack.ensure(2);
         LuaApi api = stack.api();
+        if (api.getType(index) != LuaType::UserData || api.getObjectSize(index) < headerSize)
+            return nullptr;
+        auto header = std::launder(static_cast<detail::UserDataHeader*>(api.asUserData(index)));
+        if (header->mTag != userDataTag || header->mType >= mTypes.size() || !mTypes[header->mType])
+            return nullptr;
+        // Other user data may start with the same bytes, so only trust the header if the metatable is the type's own
+        stack.ensure(1);
         if (!api.pushMetatable(index))
-            return false;
-        found->second.mMetatable.pushTo(stack);
-        bool same = api.rawEqual(-1, -2) || isSameType(stack, api, found->second.mDerived, mMetatables);
-        api.pop(2);
-        return same;
-    }
-
-    void* UserTypeRegistry::getUserData(Stack& stack, int index, const std::type_info& type) const
-    {
-        ObjectView view = stack.getObject(index);
-        if (!view.isUserData())
-            throw TypeError(type.name());
-        const auto found = mMetatables.find(type);
-        if (found == mMetatables.end())
-            throw TypeError(type.name());
-        std::optional<TableView> metatable = view.pushMetatable();
-        if (!metatable)
-            throw TypeError(type.name());
-        TableView table = found->second.mMetatable.pushTo(stack);
-        LuaApi api = stack.api();
-        detail::TypeCaster caster = nullptr;
-        bool same = api.rawEqual(-1, -2);
-        if (!same)
+            return nullptr;
+        const bool owned = api.asPointer(-1) == mTypes[header->mType]->mMetatableAddress;
+        api.pop(1);
+        return owned ? header : nullptr;
+    }
+
+    void* UserTypeRegistry::getObject(detail::UserDataHeader& header)
+    {
+        if (header.mFlags & detail::IndirectUserData)
+            return *std::launder(reinterpret_cast<void**>(&header + 1));
+        return &header + 1;
+    }
+
+    const detail::TypeCast* UserTypeRegistry::findCast(detail::TypeId from, detail::TypeId to) const
+    {
+        const std::vector<detail::TypeCast>& casts = mTypes[from]->mCasts;
+        if (to < casts.size() && casts[to].mCaster != nullptr)
+            return &casts[to];
+        return nullptr;
+    }
+
+    bool UserTypeRegistry::matches(Stack& stack, int index, detail::TypeId type) const
+    {
+        const detail::UserDataHeader* header = getHeader(stack, index);
+        if (header == nullptr)
+            return getCData(stack, index, type) != nullptr;
+        return header->mType == type || findCast(header->mType, type) != nullptr;
+    }
+
+    void* UserTypeRegistry::getUserData(Stack& stack, int index, detail::TypeId type, const std::type_info& info) const
+    {
+        detail::UserDataHeader* header = getHeader(stack, index);
+        if (header == nullptr)
         {
-            caster = isSameType(stack, api, found->second.mDerived, mMetatables);
-            same = caster != nullptr;
+            if (void* data = getCData(stack, index, type))
+                return data;
+            throw TypeError(info.name());
         }
-        if (!same)
+        if ((header->mFlags & detail::OwnedUserData) && !(header->mFlags & detail::LiveUserData))
+            throw std::runtime_error("invalid object");
+        void* pointer = getObject(*header);
+        for (detail::TypeId current = header->mType; current != type;)
         {
-            std::string_view name;
-            if (auto currentType = table["__type"].get<std::optional<std::string_view>>())
-                name = *currentType;
-            else
-                name = type.name();
-            stack.pop(2);
-            throw TypeError(name);
+            const detail::TypeCast* cast = findCast(current, type);
+            if (cast == nullptr)
+            {
+                if (type < mTypes.size() && mTypes[type])
+                {
+                    TableView table = mTypes[type]->mMetatable.pushTo(stack);
+                    auto name = table["__type"].get<std::optional<std::string>>();
+                    stack.pop();
+                    if (name)
+                        throw TypeError(*name);
+                }
+                throw TypeError(info.name());
+            }
+            pointer = cast->mCaster(pointer);
+            current = cast->mBase;
         }
-        stack.pop(2);
-        std::span<std::byte> data = view.asUserData();
-        if (data.size() < pointerSize)
-            throw std::runtime_error("invalid object");
-        void* pointer = nullptr;
-        std::memcpy(&pointer, data.data(), pointerSize);
-        if (caster != nullptr)
-            pointer = caster(pointer);
-        if (pointer == nullptr)
-            throw std::runtime_error("invalid object");
         return pointer;
     }
 
+    void UserTypeRegistry::addBase(Stack& stack, detail::TypeId type, detail::TypeId base,
+        UserDataDestructor destructor, detail::TypeCaster caster)
+    {
+        getUserTypeData(stack, base, destructor);
+        mTypes[type]->mBases.emplace_back(base, caster);
+        // Rebuild every type's cast table as bases may have been declared before or after their derived types
+        for (const std::unique_ptr<UserTypeData>& data : mTypes)
+        {
+            if (!data)
+                continue;
+            data->mCasts.clear();
+            for (const auto& [direct, directCaster] : data->mBases)
+            {
+                // Reach every base through the first direct base leading to it
+                std::vector<detail::TypeId> pending{ direct };
+                while (!pending.empty())
+                {
+                    const detail::TypeId current = pending.back();
+                    pending.pop_back();
+                    if (current >= data->mCasts.size())
+                        data->mCasts.resize(current + 1);
+                    if (data->mCasts[current].mCaster != nullptr)
+                        continue;
+                    data->mCasts[current] = { directCaster, direct };
+                    for (const auto& [next, nextCaster] : mTypes[current]->mBases)
+                        pending.push_back(next);
+                }
+            }
+        }
+    }
+
     UserType UserTypeRegistry::createUserType(
-        Stack& stack, std::type_index type, UserDataDestructor destructor, std::string_view name)
+        Stack& stack, detail::TypeId type, UserDataDestructor destructor, std::string_view name)
     {
         UserTypeData& data = getUserTypeData(stack, type, destructor);
         TableView table = data.mMetatable.pushTo(stack);
@@ -216,6 +269,169 @@ namespace lat
         }
         table["__type"] = name;
         stack.pop();
-        return UserType(stack, data.mMetatable, mDefaultIndex, mDefaultNewIndex);
+        return UserType(stack, data.mMetatable, mDefaultIndex, mDefaultNewIndex, type);
+    }
+
+    bool UserTypeRegistry::setFfiLayout(Stack& stack, detail::TypeId type, std::size_t size, std::size_t align,
+        std::span<const detail::FfiFieldInfo> fields, const TableView& metatype)
+    {
+        UserTypeData& data = *mTypes[type];
+        if (data.mFfiType.isValid())
+            throw std::logic_error("FFI fields have already been set");
+        const int top = stack.getTop();
+        if (!stack.pushFfiLibrary())
+            return false;
+        try
+        {
+            TableView metatable = data.mMetatable.pushTo(stack);
+            const std::string name = metatable["__type"].get<std::string>();
+            auto isIdentifier = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+            if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front()))
+                || !std::all_of(name.begin(), name.end(), isIdentifier))
+                throw std::invalid_argument("FFI struct names must be C identifiers: " + name);
+            std::vector<detail::FfiFieldInfo> sorted(fields.begin(), fields.end());
+            std::sort(sorted.begin(), sorted.end(),
+                [](const detail::FfiFieldInfo& l, const detail::FfiFieldInfo& r) { return l.mOffset < r.mOffset; });
+            // Gaps are filled with padding, so the declaration matches even if not every member is listed
+            std::string declaration = "struct " + name + " {";
+            std::size_t end = 0;
+            std::size_t padding = 0;
+            TableView names = stack.pushArray(static_cast<int>(sorted.size()));
+            TableView offsets = stack.pushArray(static_cast<int>(sorted.size()));
+            for (std::size_t i = 0; i < sorted.size(); ++i)
+            {
+                const detail::FfiFieldInfo& field = sorted[i];
+                if (field.mOffset < end || field.mOffset + field.mSize > size)
+                    throw std::invalid_argument("FFI field " + std::string(field.mName) + " overlaps another");
+                if (field.mOffset > end)
+                    declaration += std::format(" uint8_t latPadding{}[{}];", padding++, field.mOffset - end);
+                declaration += std::format(" {} {}", field.mType, field.mName);
+                if (field.mCount > 0)
+                    declaration += std::format("[{}]", field.mCount);
+                declaration += ';';
+                names[i + 1] = field.mName;
+                offsets[i + 1] = field.mOffset;
+                end = field.mOffset + field.mSize;
+            }
+            if (end < size)
+                declaration += std::format(" uint8_t latPadding{}[{}];", padding, size - end);
+            declaration += std::format(" }} __attribute__((aligned({})));", align);
+            // Only uses the FFI library, as the base library need not be loaded
+            FunctionView init = stack.pushFunction(R"(
+                local ffi, name, declaration, size, align, names, offsets, metatype = ...
+                ffi.cdef(declaration)
+                local ct = ffi.typeof("struct " .. name)
+                if ffi.sizeof(ct) ~= size or ffi.alignof(ct) ~= align then
+                    return nil, "struct " .. name
+                end
+                for i = 1, #names do
+                    if ffi.offsetof(ct, names[i]) ~= offsets[i] then
+                        return nil, "field " .. names[i]
+                    end
+                end
+                ffi.metatype(ct, metatype)
+                local pointer = ffi.typeof("struct " .. name .. " *")
+                local cast, istype = ffi.cast, ffi.istype
+                -- Pointers are tested first; istype accepts them for the struct itself
+                local function check(value)
+                    if istype(pointer, value) then
+                        return 2
+                    elseif istype(ct, value) then
+                        return 1
+                    end
+                    return 0
+                end
+                return ct, function(address) return cast(pointer, address) end, check
+            )",
+                "latticeFfiStruct");
+            auto [ct, cast, check] = init.invoke<std::tuple<ObjectView, ObjectView, ObjectView>>(
+                stack.getObject(top + 1), name, declaration, size, align, names, offsets, metatype);
+            if (ct.isNil())
+                throw std::invalid_argument(cast.as<std::string>() + " does not match the layout of its C++ type");
+            data.mFfiType = ct.store();
+            data.mFfiCast = cast.asFunction().store();
+            data.mFfiCheck = check.asFunction().store();
+        }
+        catch (...)
+        {
+            stack.pop(static_cast<std::uint16_t>(stack.getTop() - top));
+            throw;
+        }
+        stack.pop(static_cast<std::uint16_t>(stack.getTop() - top));
+        return true;
+    }
+
+    void* UserTypeRegistry::pushCData(Stack& stack, detail::TypeId type)
+    {
+        if (type >= mTypes.size() || !mTypes[type] || !mTypes[type]->mFfiType.isValid())
+            return nullptr;
+        mTypes[type]->mFfiType.pushTo(stack);
+        LuaApi api = stack.api();
+        // Calling the ctype creates a zero-filled instance
+        api.call(0, 1);
+        return const_cast<void*>(api.asPointer(-1));
+    }
+
+    bool UserTypeRegistry::pushCDataPointer(Stack& stack, detail::TypeId type, const void* pointer)
+    {
+        if (type >= mTypes.size() || !mTypes[type] || !mTypes[type]->mFfiCast.isValid())
+            return false;
+        mTypes[type]->mFfiCast.pushTo(stack);
+        LuaApi api = stack.api();
+        api.pushLightUserData(const_cast<void*>(pointer));
+        api.call(1, 1);
+        return true;
+    }
+
+    void* UserTypeRegistry::checkCData(Stack& stack, int index, detail::TypeId type) const
+    {
+        if (!mTypes[type]->mFfiCheck.isValid())
+            return nullptr;
+        LuaApi api = stack.api();
+        mTypes[type]->mFfiCheck.pushTo(stack);
+        api.pushCopy(index);
+        api.call(1, 1);
+        const lua_Integer kind = api.asInteger(-1);
+        api.pop(1);
+        const void* data = api.asPointer(index);
+        if (kind == 1)
+            return const_cast<void*>(data);
+        else if (kind == 2)
+            return *static_cast<void* const*>(data);
+        return nullptr;
+    }
+
+    void* UserTypeRegistry::getCData(Stack& stack, int index, detail::TypeId type) const
+    {
+#ifdef LAT_LUAJIT
+        LuaApi api = stack.api();
+        if (api.getType(index) != LuaType::CData || type >= mTypes.size() || !mTypes[type])
+            return nullptr;
+        if (index < 0)
+            index += api.getStackSize() + 1;
+        if (void* data = checkCData(stack, index, type))
+            return data;
+        // The cdata may be of a type deriving from the requested one
+        for (detail::TypeId derived = 0; derived < mTypes.size(); ++derived)
+        {
+            if (!mTypes[derived] || findCast(derived, type) == nullptr)
+                continue;
+            void* pointer = checkCData(stack, index, derived);
+            if (pointer == nullptr)
+                continue;
+            for (detail::TypeId current = derived; current != type;)
+            {
+                const detail::TypeCast* cast = findCast(current, type);
+                pointer = cast->mCaster(pointer);
+                current = cast->mBase;
+            }
+            return pointer;
+        }
+#else
+        static_cast<void>(stack);
+        static_cast<void>(index);
+        static_cast<void>(type);
+#endif
+        return nullptr;
     }
 }
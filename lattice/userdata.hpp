@@ -1,19 +1,19 @@
 #ifndef LATTICE_USERDATA_H
 #define LATTICE_USERDATA_H
 
+#include "ffi.hpp"
 #include "functionref.hpp"
 #include "object.hpp"
 #include "reference.hpp"
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <span>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
-#include <typeindex>
 #include <typeinfo>
-#include <unordered_map>
 #include <vector>
 
 namespace lat
@@ -38,12 +38,60 @@ namespace lat
         {
             return static_cast<B*>(static_cast<T*>(pointer));
         }
+
+        using TypeId = std::uint32_t;
+
+        TypeId nextTypeId();
+
+        // Process-wide IDs are handed out densely, in order of first use
+        template <UnqualifiedType T>
+        inline TypeId getTypeId()
+        {
+            static const TypeId id = nextTypeId();
+            return id;
+        }
+
+        enum UserDataFlags : std::uint16_t
+        {
+            // The object is referenced by a pointer following the header instead of being stored after it
+            IndirectUserData = 1,
+            // The object belongs to the user data and needs to be destroyed with it
+            OwnedUserData = 2,
+            // An owned object has been constructed and not yet destroyed
+            LiveUserData = 4,
+        };
+
+        // Stored at the start of every user data pushed by a UserTypeRegistry, followed by either the object itself or
+        // a pointer to it
+        struct UserDataHeader
+        {
+            TypeId mType;
+            std::uint16_t mTag;
+            std::uint16_t mFlags;
+        };
+
+        // A step towards a base type; mBase is the type mCaster converts to
+        struct TypeCast
+        {
+            TypeCaster mCaster = nullptr;
+            TypeId mBase = 0;
+        };
     };
 
     struct UserTypeData
     {
         TableReference mMetatable;
-        std::vector<std::tuple<std::type_index, detail::TypeCaster>> mDerived;
+        // The metatable's address, which stays valid as long as mMetatable keeps it alive
+        const void* mMetatableAddress = nullptr;
+        // Direct bases as declared
+        std::vector<std::tuple<detail::TypeId, detail::TypeCaster>> mBases;
+        // Every direct or indirect base, indexed by its ID
+        std::vector<detail::TypeCast> mCasts;
+        // Set for types pushed as FFI cdata: the struct's ctype, a function casting light user data to a pointer to
+        // it, and one telling which of the two a value is (1 for the struct, 2 for a pointer, 0 for neither)
+        Reference mFfiType;
+        FunctionReference mFfiCast;
+        FunctionReference mFfiCheck;
 
         UserTypeData(TableReference&& ref)
             : mMetatable(std::move(ref))
@@ -53,15 +101,19 @@ namespace lat
 
     class UserTypeRegistry
     {
-        std::unordered_map<std::type_index, UserTypeData> mMetatables;
+        // Indexed by ID; entries are never moved so references to their metatables stay valid
+        std::vector<std::unique_ptr<UserTypeData>> mTypes;
         FunctionReference mDefaultIndex;
         FunctionReference mDefaultNewIndex;
 
         friend struct MainStack;
+        friend class UserType;
 
         void clear();
 
+        static constexpr std::size_t headerSize = sizeof(detail::UserDataHeader);
         static constexpr std::size_t pointerSize = sizeof(void*);
+        static_assert(headerSize % alignof(void*) == 0);
 
         using Destructor = void (*)(void*);
 
@@ -73,46 +125,79 @@ namespace lat
             destroyUserData(view, [](void* pointer) { std::destroy_at(static_cast<T*>(pointer)); });
         }
 
-        UserTypeData& getUserTypeData(Stack&, std::type_index, UserDataDestructor);
+        UserTypeData& getUserTypeData(Stack&, detail::TypeId, UserDataDestructor);
+
+        detail::UserDataHeader& pushUserData(Stack&, std::size_t, detail::TypeId, UserDataDestructor, std::uint16_t);
+
+        void pushUserData(Stack&, const void*, detail::TypeId, UserDataDestructor);
+
+        void pushUserData(Stack&, std::size_t, std::size_t, detail::TypeId, const std::type_info&, UserDataDestructor,
+            FunctionRef<void*(void*)>);
+
+        detail::UserDataHeader* getHeader(Stack&, int) const;
+
+        static void* getObject(detail::UserDataHeader&);
+
+        const detail::TypeCast* findCast(detail::TypeId, detail::TypeId) const;
+
+        bool matches(Stack&, int, detail::TypeId) const;
 
-        std::span<std::byte> pushUserData(Stack&, std::size_t, const void*, std::type_index, UserDataDestructor);
+        void* getUserData(Stack&, int, detail::TypeId, const std::type_info&) const;
 
-        void pushUserData(
-            Stack&, std::size_t, std::size_t, const std::type_info&, UserDataDestructor, FunctionRef<void*(void*)>);
+        void addBase(Stack&, detail::TypeId, detail::TypeId, UserDataDestructor, detail::TypeCaster);
 
-        bool matches(Stack&, int, std::type_index) const;
+        UserType createUserType(Stack&, detail::TypeId, UserDataDestructor, std::string_view);
 
-        void* getUserData(Stack&, int, const std::type_info&) const;
+        bool setFfiLayout(
+            Stack&, detail::TypeId, std::size_t, std::size_t, std::span<const detail::FfiFieldInfo>, const TableView&);
 
-        UserType createUserType(Stack&, std::type_index, UserDataDestructor, std::string_view);
+        // Return null if the type is not exposed as cdata
+        void* pushCData(Stack&, detail::TypeId);
+        bool pushCDataPointer(Stack&, detail::TypeId, const void*);
+        void* getCData(Stack&, int, detail::TypeId) const;
+        // Only matches cdata of exactly the given type; index must be absolute
+        void* checkCData(Stack&, int, detail::TypeId) const;
 
     public:
         template <class Value, class T = std::remove_cvref_t<Value>>
         void pushPointer(Stack& stack, Value&& value)
         {
             static_assert(!std::is_pointer_v<T>);
-            // Light user data cannot have a unique metatable so we push a full user data the size of a pointer
-            pushUserData(stack, pointerSize, std::addressof(value), std::type_index(typeid(T)), &destroyUserData<T>);
+            if constexpr (std::is_standard_layout_v<T>)
+            {
+                if (pushCDataPointer(stack, detail::getTypeId<T>(), std::addressof(value)))
+                    return;
+            }
+            // Light user data cannot have a unique metatable so we push a full user data holding the pointer
+            pushUserData(stack, std::addressof(value), detail::getTypeId<T>(), &destroyUserData<T>);
         }
 
         template <class Value, class T = std::remove_cvref_t<Value>>
         void pushValue(Stack& stack, Value&& value)
         {
             static_assert(!std::is_pointer_v<T>);
-            pushUserData(stack, sizeof(T), alignof(T), typeid(T), &destroyUserData<T>,
+            if constexpr (std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>)
+            {
+                if (void* data = pushCData(stack, detail::getTypeId<T>()))
+                {
+                    new (data) T(std::forward<Value>(value));
+                    return;
+                }
+            }
+            pushUserData(stack, sizeof(T), alignof(T), detail::getTypeId<T>(), typeid(T), &destroyUserData<T>,
                 [&](void* pointer) { return new (pointer) T(std::forward<Value>(value)); });
         }
 
         template <class Value, class T = std::remove_cvref_t<std::remove_pointer_t<Value>>>
         bool matches(Stack& stack, int index) const
         {
-            return matches(stack, index, std::type_index(typeid(T)));
+            return matches(stack, index, detail::getTypeId<T>());
         }
 
         template <class Value, class T = std::remove_cvref_t<std::remove_pointer_t<Value>>>
         T* as(Stack& stack, int index) const
         {
-            void* value = getUserData(stack, index, typeid(T));
+            void* value = getUserData(stack, index, detail::getTypeId<T>(), typeid(T));
             return static_cast<T*>(value);
         }
 
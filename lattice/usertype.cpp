@@ -1,6 +1,7 @@
 #include "usertype.hpp"
 
 #include "function.hpp"
+#include "state.hpp"
 #include "table.hpp"
 
 namespace lat
@@ -66,11 +67,12 @@ namespace lat
     }
 
     UserType::UserType(Stack& stack, const TableReference& metatable, const FunctionReference& defaultIndex,
-        const FunctionReference& defaultNewIndex)
+        const FunctionReference& defaultNewIndex, detail::TypeId type)
         : mStack(stack)
         , mMetatable(metatable)
         , mDefaultIndex(defaultIndex)
         , mDefaultNewIndex(defaultNewIndex)
+        , mType(type)
     {
         FunctionView init = mStack.pushFunction(R"(
             local mt, getKey, setKey, propsKey, indexKey, defaultNewIndex = ...
@@ -107,6 +109,33 @@ namespace lat
         mStack.pop();
     }
 
+    bool UserType::setFfiFields(std::size_t size, std::size_t align, std::span<const detail::FfiFieldInfo> fields)
+    {
+        // Keys that are not struct fields go through the same handlers as they do for user data
+        TableView metatype = mStack.pushTable();
+        TableView metatable = mMetatable.pushTo(mStack);
+        bool set = false;
+        try
+        {
+            metatable.forEach([&](ObjectView key, ObjectView value) {
+                if (!key.isString())
+                    return;
+                const auto name = key.as<std::string_view>();
+                if ((isMetaKey(name) && name != meta::gc) || name == meta::newIndex)
+                    metatype[name] = value;
+            });
+            metatype[meta::index] = metatable[indexKey];
+            set = State::getUserTypeRegistry(mStack).setFfiLayout(mStack, mType, size, align, fields, metatype);
+        }
+        catch (...)
+        {
+            mStack.pop(2);
+            throw;
+        }
+        mStack.pop(2);
+        return set;
+    }
+
     IndexedUserType UserType::operator[](std::string_view key)
     {
         return IndexedUserType(*this, key);
@@ -1,13 +1,19 @@
 #ifndef LATTICE_USERTYPE_H
 #define LATTICE_USERTYPE_H
 
+#include "ffi.hpp"
 #include "forwardstack.hpp"
 #include "overload.hpp"
 #include "reference.hpp"
 #include "table.hpp"
 #include "userdata.hpp"
 
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace lat
 {
@@ -16,8 +22,8 @@ namespace lat
     namespace detail
     {
         template <class Type, class T = std::remove_cvref_t<Type>>
-        concept PropertyFunction
-            = Function<T> || isOverload<T> || std::is_same_v<FunctionView, T> || std::is_same_v<FunctionReference, T>;
+        concept PropertyFunction = Function<T> || isOverload<T> || isBound<T> || std::is_same_v<FunctionView, T>
+            || std::is_same_v<FunctionReference, T>;
     }
 
     class UserType
@@ -26,11 +32,13 @@ namespace lat
         const TableReference& mMetatable;
         const FunctionReference& mDefaultIndex;
         const FunctionReference& mDefaultNewIndex;
+        detail::TypeId mType;
 
         UserType(const UserType&) = delete;
         UserType(UserType&&) = default;
 
-        UserType(Stack&, const TableReference&, const FunctionReference&, const FunctionReference&);
+        UserType(
+            Stack&, const TableReference&, const FunctionReference&, const FunctionReference&, detail::TypeId);
 
         friend class UserTypeRegistry;
 
@@ -39,6 +47,8 @@ namespace lat
         TableView getters() const;
         TableView setters() const;
 
+        bool setFfiFields(std::size_t size, std::size_t align, std::span<const detail::FfiFieldInfo>);
+
     public:
         IndexedUserType operator[](std::string_view);
 
@@ -72,6 +82,26 @@ namespace lat
                 props().set(std::forward<V>(value), std::forward<K>(key));
             mStack.pop();
         }
+
+        // Declares a struct with these fields, named after the type, through LuaJIT's FFI library and from then on
+        // pushes instances as cdata of it instead of user data: by value as a copy, by pointer or reference as a
+        // pointer into C++ memory. Field accesses in scripts become plain loads and stores; other keys and metamethods
+        // fall back to the type's bindings, which accept the cdata like user data, as do bindings taking one of its
+        // bases. Metamethods are copied, so they should be declared first. Returns false, leaving the type as it is, if
+        // the FFI library is not loaded.
+        template <class T>
+        bool setFfiFields(std::initializer_list<FfiField<T>> fields)
+        {
+            static_assert(std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>,
+                "only trivially copyable, standard-layout types can be exposed as FFI structs");
+            if (detail::getTypeId<T>() != mType)
+                throw std::invalid_argument("fields do not belong to this type");
+            std::vector<detail::FfiFieldInfo> infos;
+            infos.reserve(fields.size());
+            for (const FfiField<T>& field : fields)
+                infos.push_back(field.getInfo());
+            return setFfiFields(sizeof(T), alignof(T), infos);
+        }
     };
 
     class IndexedUserType
@@ -101,11 +131,9 @@ namespace lat
     template <detail::UnqualifiedType T, detail::BaseType<T>... Bases>
     UserType UserTypeRegistry::createUserType(Stack& stack, std::string_view name)
     {
-        const auto& type = typeid(T);
+        const detail::TypeId type = detail::getTypeId<T>();
         UserType created = createUserType(stack, type, &destroyUserData<T>, name);
-        (getUserTypeData(stack, typeid(Bases), &destroyUserData<Bases>)
-                .mDerived.emplace_back(type, &detail::baseCast<T, Bases>),
-            ...);
+        (addBase(stack, type, detail::getTypeId<Bases>(), &destroyUserData<Bases>, &detail::baseCast<T, Bases>), ...);
         return created;
     }
 }
@@ -0,0 +1,78 @@
+#include <arenaallocator.hpp>
+#include <exception.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <new>
+
+namespace
+{
+    using namespace lat;
+
+    void* allocate(ArenaAllocator& arena, void* pointer, std::size_t oldSize, std::size_t newSize)
+    {
+        return ArenaAllocator::allocate(&arena, pointer, oldSize, newSize);
+    }
+
+    TEST(ArenaAllocatorTest, only_the_last_block_changes_in_place)
+    {
+        ArenaAllocator arena;
+        void* first = allocate(arena, nullptr, 0, 10);
+        std::memcpy(first, "first", 6);
+        EXPECT_EQ(allocate(arena, first, 10, 100), first);
+        void* second = allocate(arena, nullptr, 0, 20);
+        EXPECT_EQ(static_cast<std::byte*>(second) - static_cast<std::byte*>(first), 112);
+        void* moved = allocate(arena, first, 100, 200);
+        EXPECT_NE(moved, first);
+        EXPECT_STREQ(static_cast<const char*>(moved), "first");
+        EXPECT_EQ(allocate(arena, moved, 200, 0), nullptr);
+        // Freeing the last block hands its memory back
+        EXPECT_EQ(arena.getStats().mUsed, 112 + 32);
+        EXPECT_EQ(allocate(arena, nullptr, 0, 16), moved);
+        EXPECT_EQ(arena.getStats().mUsed, 112 + 32 + 16);
+        EXPECT_EQ(arena.getStats().mChunkCount, 1);
+    }
+
+    TEST(ArenaAllocatorTest, can_back_a_state)
+    {
+        ArenaAllocator arena;
+        for (int i = 0; i < 3; ++i)
+        {
+            {
+                State state(&ArenaAllocator::allocate, &arena);
+                state.loadLibraries();
+                state.withStack([](Stack& stack) {
+                    EXPECT_EQ(stack.execute<int>("local t = {} for i = 1, 1000 do t[i] = tostring(i) end return #t"),
+                        1000);
+                });
+                EXPECT_GT(arena.getStats().mUsed, 0);
+            }
+            arena.reset();
+            const ArenaAllocatorStats stats = arena.getStats();
+            EXPECT_EQ(stats.mUsed, 0);
+            EXPECT_EQ(stats.mChunkCount, 1);
+            EXPECT_EQ(stats.mReserved, 64 * 1024);
+        }
+    }
+
+    TEST(ArenaAllocatorTest, limit_causes_memory_errors)
+    {
+        ArenaAllocator arena(256 * 1024, 16 * 1024);
+        State state(&ArenaAllocator::allocate, &arena);
+        state.withStack([](Stack& stack) {
+            EXPECT_THROW(stack.execute("local t = {} for i = 1, 1000000 do t[i] = i end"), MemoryError);
+        });
+        const ArenaAllocatorStats stats = arena.getStats();
+        EXPECT_LE(stats.mReserved, 256 * 1024);
+        EXPECT_GT(stats.mRefused, 0);
+    }
+
+    TEST(ArenaAllocatorTest, state_constructor_throws_without_memory)
+    {
+        ArenaAllocator arena(64);
+        EXPECT_THROW(State(&ArenaAllocator::allocate, &arena), std::bad_alloc);
+    }
+}
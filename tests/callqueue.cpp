@@ -0,0 +1,143 @@
+#include <callqueue.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    struct CallQueueTest : public testing::Test
+    {
+        State mState;
+    };
+
+    TEST_F(CallQueueTest, runs_posted_calls_in_order)
+    {
+        std::vector<int> calls;
+        for (int i = 0; i < 3; ++i)
+            mState.getCallQueue().post([&, i](Stack&) { calls.push_back(i); });
+        EXPECT_TRUE(calls.empty());
+        EXPECT_EQ(mState.pump(), 3);
+        EXPECT_EQ(calls, (std::vector<int>{ 0, 1, 2 }));
+        EXPECT_EQ(mState.pump(), 0);
+    }
+
+    TEST_F(CallQueueTest, can_post_from_other_threads)
+    {
+        constexpr int perThread = 1000;
+        std::vector<std::vector<int>> received(4);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < perThread; ++i)
+                    mState.getCallQueue().post([&, t, i](Stack&) { received[t].push_back(i); });
+            });
+        }
+        std::size_t total = 0;
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+            total += mState.pump();
+        }
+        EXPECT_EQ(total, 4 * perThread);
+        for (const std::vector<int>& values : received)
+        {
+            ASSERT_EQ(values.size(), perThread);
+            for (int i = 0; i < perThread; ++i)
+                EXPECT_EQ(values[i], i);
+        }
+    }
+
+    TEST_F(CallQueueTest, can_call_lua_functions)
+    {
+        mState.withStack([](Stack& stack) { stack.execute("function onLoaded(name, size) loaded = name .. size end"); });
+        std::thread([&] { mState.getCallQueue().postCall("onLoaded", std::string("texture"), 42); }).join();
+        EXPECT_EQ(mState.pump(), 1);
+        mState.withStack([](Stack& stack) {
+            EXPECT_EQ(stack.execute<std::string>("return loaded"), "texture42");
+            EXPECT_EQ(stack.getTop(), 0);
+        });
+    }
+
+    TEST_F(CallQueueTest, calls_after_an_error_stay_queued)
+    {
+        std::vector<int> calls;
+        CallQueue& queue = mState.getCallQueue();
+        queue.post([&](Stack&) { calls.push_back(1); });
+        queue.post([](Stack&) { throw std::runtime_error("failed"); });
+        queue.post([&](Stack&) { calls.push_back(3); });
+        EXPECT_THROW(mState.pump(), std::runtime_error);
+        EXPECT_EQ(calls, std::vector<int>{ 1 });
+        queue.post([&](Stack&) { calls.push_back(4); });
+        EXPECT_EQ(mState.pump(), 2);
+        EXPECT_EQ(calls, (std::vector<int>{ 1, 3, 4 }));
+    }
+
+    TEST_F(CallQueueTest, failed_lua_calls_are_popped)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) { stack.execute("function fail() error('failed') end"); });
+        mState.getCallQueue().postCall("fail");
+        mState.withStack([&](Stack& stack) {
+            EXPECT_THROW(mState.getCallQueue().drain(stack), std::runtime_error);
+            EXPECT_EQ(stack.getTop(), 0);
+        });
+    }
+
+    TEST_F(CallQueueTest, can_pump_from_the_debug_hook)
+    {
+        mState.loadLibraries();
+        int calls = 0;
+        mState.getCallQueue().post([&](Stack& stack) {
+            ++calls;
+            stack["done"] = true;
+        });
+        mState.setHookPumpInterval(100);
+        mState.withStack([](Stack& stack) {
+            // Only finishes once the posted call ran
+            stack.execute("done = false while not done do end");
+        });
+        EXPECT_EQ(calls, 1);
+        mState.setHookPumpInterval(0);
+        mState.getCallQueue().post([&](Stack&) { ++calls; });
+        mState.withStack([](Stack& stack) { stack.execute("for i = 1, 1000 do end"); });
+        EXPECT_EQ(calls, 1);
+    }
+
+    TEST_F(CallQueueTest, errors_do_not_reach_the_interrupted_script)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) { stack.execute("function fail() error('failed') end"); });
+        CallQueue& queue = mState.getCallQueue();
+        queue.postCall("fail");
+        queue.post([](Stack& stack) { stack["done"] = true; });
+        mState.setHookPumpInterval(100);
+        mState.withStack([](Stack& stack) {
+            EXPECT_NO_THROW(stack.execute("done = false while not done do end"));
+            EXPECT_EQ(stack.getTop(), 0);
+        });
+        mState.setHookPumpInterval(0);
+        // Left for the next pump
+        EXPECT_THROW(mState.pump(), std::runtime_error);
+        EXPECT_EQ(mState.pump(), 0);
+
+        std::vector<std::string> errors;
+        queue.setErrorHandler([&](std::string_view error) { errors.emplace_back(error); });
+        queue.postCall("fail");
+        queue.post([](Stack& stack) { stack["done"] = true; });
+        mState.setHookPumpInterval(100);
+        mState.withStack([](Stack& stack) { stack.execute("done = false while not done do end"); });
+        ASSERT_EQ(errors.size(), 1);
+        EXPECT_NE(errors[0].find("failed"), std::string::npos);
+        EXPECT_EQ(mState.pump(), 0);
+    }
+}
@@ -3,6 +3,13 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <map>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace
 {
     using namespace lat;
@@ -129,4 +136,59 @@ namespace
             EXPECT_EQ(1, stack.getTop());
         });
     }
+
+    TEST_F(ConversionTest, can_push_and_pull_sequences)
+    {
+        mState.withStack([](Stack& stack) {
+            const std::vector<int> vector{ 1, 2, 3 };
+            ObjectView view = stack.push(vector);
+            EXPECT_TRUE(view.isTable());
+            EXPECT_EQ(view.asTable().size(), vector.size());
+            EXPECT_TRUE(view.is<std::vector<int>>());
+            EXPECT_EQ(view.as<std::vector<int>>(), vector);
+            EXPECT_EQ((view.as<std::array<double, 3>>()), (std::array<double, 3>{ 1., 2., 3. }));
+            const std::array<std::string, 2> array{ "a", "b" };
+            EXPECT_EQ(stack.push(array).as<std::vector<std::string>>(), (std::vector<std::string>{ "a", "b" }));
+            const int cArray[] = { 4, 5 };
+            EXPECT_EQ(stack.push(cArray).as<std::vector<int>>(), (std::vector<int>{ 4, 5 }));
+            EXPECT_EQ(stack.push(std::span(vector).subspan(1)).as<std::vector<int>>(), (std::vector<int>{ 2, 3 }));
+            EXPECT_EQ(stack.push(std::vector<bool>{ true, false }).as<std::vector<bool>>(),
+                (std::vector<bool>{ true, false }));
+            EXPECT_ANY_THROW(stack.push(array).as<std::vector<int>>());
+        });
+    }
+
+    TEST_F(ConversionTest, can_push_and_pull_maps)
+    {
+        mState.withStack([](Stack& stack) {
+            const std::map<std::string, int> map{ { "a", 1 }, { "b", 2 } };
+            ObjectView view = stack.push(map);
+            EXPECT_EQ(view.asTable()["b"].get<int>(), 2);
+            EXPECT_EQ((view.as<std::map<std::string, int>>()), map);
+            const auto unordered = view.as<std::unordered_map<std::string, double>>();
+            EXPECT_EQ(unordered.size(), map.size());
+            EXPECT_EQ(unordered.at("a"), 1.);
+        });
+    }
+
+    TEST_F(ConversionTest, can_pass_containers_to_functions)
+    {
+        mState.loadLibraries({ { Library::Base } });
+        mState.withStack([](Stack& stack) {
+            stack["sum"] = [](const std::vector<int>& values) {
+                int sum = 0;
+                for (int value : values)
+                    sum += value;
+                return sum;
+            };
+            stack["range"] = [](int size) {
+                std::vector<int> values(static_cast<std::size_t>(size));
+                for (int i = 0; i < size; ++i)
+                    values[static_cast<std::size_t>(i)] = i + 1;
+                return values;
+            };
+            EXPECT_EQ(stack.execute<int>("return sum(range(4))"), 10);
+            EXPECT_ANY_THROW(stack.execute("sum(1)"));
+        });
+    }
 }
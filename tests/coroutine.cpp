@@ -0,0 +1,154 @@
+#include <coroutine.hpp>
+#include <reference.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    struct CoroutineTest : public testing::Test
+    {
+        State mState;
+
+        CoroutineTest() { mState.loadLibraries({ { Library::Base } }); }
+    };
+
+    TEST_F(CoroutineTest, can_resume_until_finished)
+    {
+        mState.withStack([](Stack& stack) {
+            FunctionView body = stack.pushFunction(R"(
+                local a = ...
+                local b = coroutine.yield(a + 1)
+                local c = coroutine.yield(b * 2)
+                return a + b + c
+            )");
+            Coroutine coroutine = stack.pushCoroutine(body);
+            EXPECT_EQ(coroutine.getStatus(), CoroutineStatus::Suspended);
+            EXPECT_EQ(coroutine.resume<int>(1), 2);
+            EXPECT_EQ(coroutine.getStatus(), CoroutineStatus::Yielded);
+            EXPECT_EQ(coroutine.resume<int>(3), 6);
+            EXPECT_TRUE(coroutine.isResumable());
+            EXPECT_EQ(coroutine.resume<int>(5), 9);
+            EXPECT_EQ(coroutine.getStatus(), CoroutineStatus::Finished);
+            EXPECT_FALSE(coroutine.isResumable());
+            EXPECT_THROW(coroutine.resume(), std::runtime_error);
+            EXPECT_EQ(stack.getTop(), 2);
+        });
+    }
+
+    TEST_F(CoroutineTest, can_yield_multiple_values)
+    {
+        mState.withStack([](Stack& stack) {
+            Coroutine coroutine = stack.pushCoroutine(stack.pushFunction("coroutine.yield(1, 'a', true) return 2"));
+            auto [i, s, b] = coroutine.resume<std::tuple<int, std::string, bool>>();
+            EXPECT_EQ(i, 1);
+            EXPECT_EQ(s, "a");
+            EXPECT_TRUE(b);
+            auto rest = coroutine.resume<std::tuple<int, std::optional<int>>>();
+            EXPECT_EQ(rest, std::make_tuple(2, std::nullopt));
+            EXPECT_EQ(stack.getTop(), 2);
+        });
+    }
+
+    TEST_F(CoroutineTest, errors_are_reported)
+    {
+        mState.withStack([](Stack& stack) {
+            Coroutine coroutine = stack.pushCoroutine(stack.pushFunction("coroutine.yield() error('failed')"));
+            coroutine.resume();
+            EXPECT_THROW(coroutine.resume(), std::runtime_error);
+            EXPECT_EQ(coroutine.getStatus(), CoroutineStatus::Errored);
+            EXPECT_THROW(coroutine.resume(), std::runtime_error);
+            EXPECT_EQ(stack.getTop(), 2);
+        });
+    }
+
+    TEST_F(CoroutineTest, can_resume_coroutines_created_in_lua)
+    {
+        mState.withStack([](Stack& stack) {
+            Coroutine coroutine = stack.execute<Coroutine>(
+                "return coroutine.create(function(a) while true do a = coroutine.yield(a * a) end end)");
+            for (int i = 1; i < 4; ++i)
+                EXPECT_EQ(coroutine.resume<int>(i), i * i);
+            EXPECT_TRUE(stack.getObject(-1).is<Coroutine>());
+        });
+    }
+
+    TEST_F(CoroutineTest, can_store_coroutines)
+    {
+        std::vector<CoroutineReference> tasks;
+        mState.withStack([&](Stack& stack) {
+            FunctionView body = stack.pushFunction("local n = ... while true do n = n + coroutine.yield(n) end");
+            for (int i = 0; i < 3; ++i)
+                tasks.emplace_back(stack.pushCoroutine(body).store());
+            stack.pop(4);
+        });
+        mState.withStack([](Stack& stack) { stack.collectGarbage(); });
+        for (int round = 0; round < 2; ++round)
+        {
+            for (std::size_t i = 0; i < tasks.size(); ++i)
+            {
+                tasks[i].onStack([&](Stack&, Coroutine coroutine) {
+                    EXPECT_EQ(coroutine.resume<int>(static_cast<int>(i)), static_cast<int>(i * (round + 1)));
+                });
+            }
+        }
+    }
+
+    TEST_F(CoroutineTest, finished_threads_can_be_recycled)
+    {
+        mState.setCoroutinePoolCapacity(1);
+        mState.withStack([&](Stack& stack) {
+            FunctionView body = stack.pushFunction("local a = ... return a + coroutine.yield()");
+            Coroutine first = stack.pushCoroutine(body);
+            first.resume(1);
+            EXPECT_FALSE(first.recycle());
+            EXPECT_EQ(first.resume<int>(2), 3);
+            EXPECT_TRUE(first.recycle());
+            Coroutine second = stack.pushCoroutine(body);
+            EXPECT_TRUE(stack.same(first.getIndex(), second.getIndex()));
+            EXPECT_EQ(second.getStatus(), CoroutineStatus::Suspended);
+            second.resume(3);
+            EXPECT_EQ(second.resume<int>(4), 7);
+            Coroutine third = stack.pushCoroutine(body);
+            third.resume(5);
+            EXPECT_EQ(third.resume<int>(6), 11);
+            EXPECT_TRUE(second.recycle());
+            // The pool only holds one thread
+            EXPECT_FALSE(third.recycle());
+        });
+        const CoroutinePoolStats stats = mState.getCoroutinePoolStats();
+        EXPECT_EQ(stats.mReused, 1);
+        EXPECT_EQ(stats.mCreated, 2);
+        EXPECT_EQ(stats.mSize, 1);
+        EXPECT_EQ(stats.mCapacity, 1);
+    }
+
+    TEST_F(CoroutineTest, failed_threads_are_not_recycled)
+    {
+        mState.setCoroutinePoolCapacity(1);
+        mState.withStack([&](Stack& stack) {
+            Coroutine coroutine = stack.pushCoroutine(stack.pushFunction("error('failed')"));
+            EXPECT_THROW(coroutine.resume(), std::runtime_error);
+            EXPECT_FALSE(coroutine.recycle());
+        });
+        EXPECT_EQ(mState.getCoroutinePoolStats().mSize, 0);
+    }
+
+    TEST_F(CoroutineTest, recycling_is_disabled_by_default)
+    {
+        mState.withStack([&](Stack& stack) {
+            Coroutine coroutine = stack.pushCoroutine(stack.pushFunction("return 1"));
+            coroutine.resume();
+            EXPECT_FALSE(coroutine.recycle());
+        });
+        EXPECT_EQ(mState.getCoroutinePoolStats().mCreated, 0);
+    }
+}
@@ -0,0 +1,295 @@
+#include <ffi.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+#include <tracediagnostics.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    using namespace lat;
+
+    double dot(double x1, double y1, double x2, double y2)
+    {
+        return x1 * x2 + y1 * y2;
+    }
+
+    std::int64_t square(std::int64_t value) noexcept
+    {
+        return value * value;
+    }
+
+    int calls = 0;
+
+    void count()
+    {
+        ++calls;
+    }
+
+    bool isEven(std::uint32_t value)
+    {
+        return value % 2 == 0;
+    }
+
+    struct Vec3
+    {
+        float x;
+        float y;
+        float z;
+    };
+
+    struct Transform
+    {
+        std::int32_t mId;
+        // Not exposed, so it is padded over
+        std::int32_t mFlags;
+        double mMatrix[4];
+    };
+
+    struct Entity
+    {
+        std::int32_t mId;
+    };
+
+    struct Player : Entity
+    {
+    };
+
+    void declareVec3(Stack& stack, bool expectFfi)
+    {
+        auto type = stack.newUserType<Vec3>("Vec3");
+        type["length"] = [](const Vec3& v) { return std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z); };
+        type["scaled"] = [](const Vec3& v, float f) { return Vec3{ v.x * f, v.y * f, v.z * f }; };
+        type[meta::add] = [](const Vec3& l, const Vec3& r) { return Vec3{ l.x + r.x, l.y + r.y, l.z + r.z }; };
+        EXPECT_EQ(type.setFfiFields<Vec3>({ { "x", &Vec3::x }, { "y", &Vec3::y }, { "z", &Vec3::z } }), expectFfi);
+    }
+
+    static_assert(detail::FfiSignature<decltype(&dot)>::valid);
+    static_assert(!detail::FfiSignature<void (*)(const char*)>::valid);
+    static_assert(!detail::FfiSignature<void (*)(int&)>::valid);
+
+    struct FfiTest : public testing::Test
+    {
+        State mState;
+    };
+
+    TEST_F(FfiTest, describes_signatures_in_c)
+    {
+        EXPECT_EQ(detail::FfiSignature<decltype(&dot)>::getType(), "double (*)(double, double, double, double)");
+        EXPECT_EQ(detail::FfiSignature<decltype(&square)>::getType(), "double (*)(double)");
+        EXPECT_EQ(detail::FfiSignature<decltype(&count)>::getType(), "void (*)(void)");
+        EXPECT_EQ(detail::FfiSignature<decltype(&isEven)>::getType(), "bool (*)(uint32_t)");
+        EXPECT_EQ((detail::FfiSignature<std::int8_t (*)(char16_t, float)>::getType()), "int8_t (*)(uint16_t, float)");
+    }
+
+    TEST_F(FfiTest, bound_functions_work_with_and_without_ffi)
+    {
+        for (bool ffi : { false, true })
+        {
+            State state;
+            if (ffi)
+                state.loadLibraries({ { Library::Base, Library::FFI } });
+            else
+                state.loadLibraries({ { Library::Base } });
+            calls = 0;
+            state.withStack([](Stack& stack) {
+                stack["dot"] = bindFfi<&dot>;
+                stack["square"] = bindFfi<&square>;
+                stack["count"] = bindFfi<&count>;
+                stack["isEven"] = bindFfi<&isEven>;
+                EXPECT_EQ(stack.execute<double>("return dot(1, 2, 3, 4)"), 11.);
+                EXPECT_EQ(stack.execute<std::string>("return type(square(3))"), "number");
+                EXPECT_EQ(stack.execute<double>("return square(3) + 1"), 10.);
+                EXPECT_TRUE(stack.execute<bool>("count() return isEven(4) and not isEven(3)"));
+            });
+            EXPECT_EQ(calls, 1);
+        }
+    }
+
+#ifdef LAT_LUAJIT
+    TEST_F(FfiTest, pushes_cdata_if_the_ffi_library_is_loaded)
+    {
+        mState.loadLibraries({ { Library::Base, Library::FFI } });
+        mState.withStack([](Stack& stack) {
+            stack["dot"] = bindFfi<&dot>;
+            EXPECT_EQ(stack.execute<std::string>("return type(dot)"), "cdata");
+        });
+    }
+
+    TEST_F(FfiTest, compiled_loops_do_not_leave_the_trace)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) {
+            stack["dot"] = bindFfi<&dot>;
+            stack["slowDot"] = bind<&dot>;
+        });
+        TraceDiagnostics diagnostics(mState);
+        diagnostics.start();
+        double sum = 1;
+        mState.withStack([&](Stack& stack) {
+            sum = stack.execute<double>(R"(
+                local s = 0
+                for i = 1, 1000 do
+                    s = s + dot(i, 1, 1, 1)
+                end
+                for i = 1, 1000 do
+                    s = s - slowDot(i, 1, 1, 1)
+                end
+                return s
+            )");
+        });
+        diagnostics.stop();
+        EXPECT_EQ(sum, 0.);
+        bool slowDotStitched = false;
+        for (const TraceIssue& issue : diagnostics.getIssues())
+        {
+            EXPECT_NE(issue.mFunction, "dot") << diagnostics.getReport();
+            slowDotStitched |= issue.mFunction == "slowDot";
+        }
+        EXPECT_TRUE(slowDotStitched) << diagnostics.getReport();
+    }
+
+    TEST_F(FfiTest, pushes_structs_as_cdata)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) {
+            declareVec3(stack, true);
+            stack["sum"] = [](Vec3 v) { return v.x + v.y + v.z; };
+            stack["v"] = Vec3{ 1, 2, 2 };
+            EXPECT_EQ(stack.execute<std::string>("return type(v)"), "cdata");
+            EXPECT_EQ(stack.execute<float>("return v.x + v.y + v.z"), 5.f);
+            EXPECT_EQ(stack.execute<float>("return v:length()"), 3.f);
+            EXPECT_EQ(stack.execute<float>("return sum(v:scaled(2))"), 10.f);
+            EXPECT_EQ(stack.execute<float>("return (v + v).z"), 4.f);
+            stack.execute("v.x = 3");
+            Vec3 copy = stack["v"];
+            EXPECT_EQ(copy.x, 3.f);
+        });
+    }
+
+    TEST_F(FfiTest, pushes_pointers_into_cpp_memory)
+    {
+        mState.loadLibraries();
+        Vec3 vec{ 1, 2, 3 };
+        mState.withStack([&](Stack& stack) {
+            declareVec3(stack, true);
+            stack["v"] = &vec;
+            stack.execute("v.x = v.y + v.z");
+            EXPECT_EQ(vec.x, 5.f);
+            Vec3* pointer = stack["v"];
+            EXPECT_EQ(pointer, &vec);
+            EXPECT_EQ(stack.execute<float>("return v:length()"), std::sqrt(38.f));
+        });
+    }
+
+    TEST_F(FfiTest, cdata_is_accepted_as_a_base_type)
+    {
+        mState.loadLibraries();
+        Player player;
+        player.mId = 3;
+        mState.withStack([&](Stack& stack) {
+            stack.newUserType<Entity>("Entity");
+            auto type = stack.newUserType<Player, Entity>("Player");
+            EXPECT_TRUE(type.setFfiFields<Player>({ { "id", static_cast<std::int32_t Player::*>(&Player::mId) } }));
+            stack["getId"] = [](const Entity& entity) { return entity.mId; };
+            stack["player"] = &player;
+            stack["copy"] = player;
+            EXPECT_EQ(stack.execute<std::string>("return type(player)"), "cdata");
+            EXPECT_EQ(stack.execute<int>("player.id = 4 return getId(player) + getId(copy)"), 7);
+            Entity* entity = stack["player"];
+            EXPECT_EQ(entity, &player);
+        });
+    }
+
+    TEST_F(FfiTest, pads_unlisted_members)
+    {
+        mState.loadLibraries();
+        Transform transform{ 7, 1, { 1, 2, 3, 4 } };
+        mState.withStack([&](Stack& stack) {
+            auto type = stack.newUserType<Transform>("Transform");
+            EXPECT_TRUE(type.setFfiFields<Transform>({ { "id", &Transform::mId }, { "m", &Transform::mMatrix } }));
+            stack["t"] = &transform;
+            EXPECT_EQ(stack.execute<double>("return t.id + t.m[0] + t.m[3]"), 12.);
+            EXPECT_EQ(stack.execute<int>("return require('ffi').sizeof(t[0])"), static_cast<int>(sizeof(Transform)));
+        });
+    }
+
+    TEST_F(FfiTest, rejects_invalid_layouts)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) {
+            auto type = stack.newUserType<Vec3>("Vec 3");
+            EXPECT_THROW(type.setFfiFields<Vec3>({ { "x", &Vec3::x } }), std::invalid_argument);
+            EXPECT_THROW(type.setFfiFields<Transform>({ { "id", &Transform::mId } }), std::invalid_argument);
+            auto transform = stack.newUserType<Transform>("Transform");
+            EXPECT_THROW(transform.setFfiFields<Transform>({ { "id", &Transform::mId }, { "flags", &Transform::mId } }),
+                std::invalid_argument);
+        });
+    }
+
+    TEST_F(FfiTest, struct_fields_do_not_leave_the_trace)
+    {
+        mState.loadLibraries();
+        std::vector<Vec3> points(100, Vec3{ 1, 2, 3 });
+        mState.withStack([&](Stack& stack) {
+            declareVec3(stack, true);
+            stack["points"] = points;
+        });
+        TraceDiagnostics diagnostics(mState);
+        diagnostics.start();
+        double sum = 0;
+        mState.withStack([&](Stack& stack) {
+            sum = stack.execute<double>(R"(
+                local s = 0
+                for _ = 1, 10 do
+                    for i = 1, #points do
+                        local p = points[i]
+                        s = s + p.x + p.y + p.z
+                    end
+                end
+                return s
+            )");
+        });
+        diagnostics.stop();
+        EXPECT_EQ(sum, 6000.);
+        EXPECT_TRUE(diagnostics.getIssues().empty()) << diagnostics.getReport();
+        EXPECT_GT(diagnostics.getTraceCount(), 0);
+    }
+
+    TEST_F(FfiTest, structs_stay_user_data_without_the_ffi_library)
+    {
+        mState.loadLibraries({ { Library::Base } });
+        mState.withStack([](Stack& stack) {
+            declareVec3(stack, false);
+            stack["v"] = Vec3{ 1, 2, 2 };
+            EXPECT_EQ(stack.execute<std::string>("return type(v)"), "userdata");
+            EXPECT_EQ(stack.execute<float>("return v:length()"), 3.f);
+        });
+    }
+#else
+    TEST_F(FfiTest, structs_stay_user_data)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) {
+            declareVec3(stack, false);
+            stack["v"] = Vec3{ 1, 2, 2 };
+            EXPECT_EQ(stack.execute<std::string>("return type(v)"), "userdata");
+            EXPECT_EQ(stack.execute<float>("return v:length()"), 3.f);
+        });
+    }
+
+    TEST_F(FfiTest, falls_back_to_plain_functions)
+    {
+        mState.loadLibraries();
+        mState.withStack([](Stack& stack) {
+            stack["dot"] = bindFfi<&dot>;
+            EXPECT_EQ(stack.execute<std::string>("return type(dot)"), "function");
+        });
+    }
+#endif
+}
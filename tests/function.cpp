@@ -4,6 +4,12 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
 namespace
 {
     using namespace lat;
@@ -128,6 +134,105 @@ namespace
         });
     }
 
+    TEST_F(FunctionTest, captures_are_destroyed_with_function)
+    {
+        mState.withStack([](Stack& stack) {
+            auto captured = std::make_shared<int>(1);
+            stack.pushFunction([captured] { return *captured; });
+            EXPECT_EQ(captured.use_count(), 2);
+            stack.pop();
+            stack.collectGarbage();
+            EXPECT_EQ(captured.use_count(), 1);
+        });
+    }
+
+    TEST_F(FunctionTest, can_capture_overaligned_values)
+    {
+        struct alignas(64) Aligned
+        {
+            int mValue;
+        };
+        mState.withStack([](Stack& stack) {
+            Aligned aligned{ 3 };
+            FunctionView function = stack.pushFunction([aligned] {
+                EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&aligned) % alignof(Aligned), 0);
+                return aligned.mValue;
+            });
+            EXPECT_EQ(function.invoke<int>(), 3);
+        });
+    }
+
+    int addOne(int value)
+    {
+        return value + 1;
+    }
+
+    TEST_F(FunctionTest, can_bind_functions_at_compile_time)
+    {
+        mState.loadLibraries({ { Library::Base, Library::Debug } });
+        mState.withStack([](Stack& stack) {
+            stack["f"] = stack.pushFunction<&addOne>();
+            stack.pop();
+            stack["g"] = bind<[](int a, int b) { return a * b; }>;
+            EXPECT_EQ(stack.execute<int>("return f(g(2, 3))"), 7);
+            EXPECT_EQ(stack.execute<int>("return debug.getinfo(f, 'u').nups + debug.getinfo(g, 'u').nups"), 0);
+        });
+    }
+
+    struct Counter
+    {
+        int mValue = 0;
+
+        int get() const { return mValue; }
+        void add(int value) noexcept { mValue += value; }
+    };
+
+    TEST_F(FunctionTest, can_bind_member_functions)
+    {
+        mState.withStack([](Stack& stack) {
+            auto type = stack.newUserType<Counter>("Counter");
+            type["add"] = bind<&Counter::add>;
+            type.setReadOnlyProperty("value", bind<&Counter::get>);
+            Counter counter;
+            stack["c"] = &counter;
+            stack.execute("c:add(2) c:add(c.value)");
+            EXPECT_EQ(counter.mValue, 4);
+        });
+    }
+
+    TEST_F(FunctionTest, argument_errors_name_the_argument)
+    {
+        mState.withStack([](Stack& stack) {
+            stack["f"] = [](int a, int b) { return a + b; };
+            try
+            {
+                stack.execute("f(1, {})");
+                FAIL();
+            }
+            catch (const std::runtime_error& e)
+            {
+                EXPECT_NE(std::string_view(e.what()).find("#2"), std::string_view::npos) << e.what();
+            }
+        });
+    }
+
+    TEST_F(FunctionTest, arguments_stay_on_the_stack)
+    {
+        mState.loadLibraries({ { Library::Base } });
+        mState.withStack([](Stack& stack) {
+            stack["f"] = [](Stack& s, std::string_view a, std::optional<int> b, const std::string& c, ObjectView d) {
+                EXPECT_EQ(s.getTop(), 4);
+                EXPECT_EQ(a, "a1");
+                EXPECT_FALSE(b.has_value());
+                EXPECT_EQ(c, "c");
+                EXPECT_EQ(d.getIndex(), 4);
+                s.collectGarbage();
+                return std::string(a) + c + std::string(d.asString());
+            };
+            EXPECT_EQ(stack.execute<std::string>("return f('a' .. 1, 'b', 'c', 'd')"), "a1cd");
+        });
+    }
+
     TEST_F(FunctionTest, can_convert_lua_arguments)
     {
         mState.withStack([](Stack& stack) {
@@ -184,6 +289,45 @@ namespace
         });
     }
 
+    TEST_F(FunctionTest, overloads_prefer_matching_argument_count)
+    {
+        mState.withStack([](Stack& stack) {
+            stack["f"] = Overload([](int) { return 1; }, [](int, int) { return 2; },
+                [](int, std::optional<int>, std::string_view) { return 3; });
+            EXPECT_EQ(stack.execute<int>("return f(1)"), 1);
+            EXPECT_EQ(stack.execute<int>("return f(1, 2)"), 2);
+            EXPECT_EQ(stack.execute<int>("return f(1, 2, 'a')"), 3);
+            EXPECT_EQ(stack.execute<int>("return f(1, nil, 'a')"), 3);
+            EXPECT_EQ(stack.execute<int>("return f(1, 2, 3, 4)"), 1);
+            EXPECT_ANY_THROW(stack.execute("f('a')"));
+            EXPECT_ANY_THROW(stack.execute("f()"));
+        });
+    }
+
+    struct Point
+    {
+        int mX;
+    };
+
+    struct Size
+    {
+        int mWidth;
+    };
+
+    TEST_F(FunctionTest, overloads_can_tell_usertypes_apart)
+    {
+        mState.withStack([](Stack& stack) {
+            stack["f"] = Overload([](const Point& point) { return point.mX; },
+                [](const Size& size) { return -size.mWidth; }, [](double value) { return static_cast<int>(value); });
+            stack["p"] = Point{ 2 };
+            stack["s"] = Size{ 3 };
+            EXPECT_EQ(stack.execute<int>("return f(p)"), 2);
+            EXPECT_EQ(stack.execute<int>("return f(s)"), -3);
+            EXPECT_EQ(stack.execute<int>("return f(4)"), 4);
+            EXPECT_ANY_THROW(stack.execute("f('a')"));
+        });
+    }
+
     TEST_F(FunctionTest, can_return_table_value)
     {
         mState.loadLibraries({ { Library::Base } });
@@ -0,0 +1,96 @@
+#include <jitprofiler.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    using namespace lat;
+    using namespace std::chrono_literals;
+
+#ifdef LAT_LUAJIT
+    struct JitProfilerTest : public testing::Test
+    {
+        State mState;
+
+        JitProfilerTest()
+        {
+            mState.loadLibraries();
+            mState.withStack([](Stack& stack) {
+                stack.pushFunction(R"(
+                    function busy(seconds)
+                        local start, s = os.clock(), 0
+                        while os.clock() - start < seconds do
+                            for i = 1, 10000 do s = s + i % 7 end
+                        end
+                        return s
+                    end
+                )", "=busy")();
+            });
+        }
+
+        void run(double seconds)
+        {
+            mState.withStack([&](Stack& stack) {
+                FunctionView busy = stack["busy"];
+                busy(seconds);
+                stack.pop();
+            });
+        }
+    };
+
+    TEST_F(JitProfilerTest, aggregates_samples_by_function_and_vm_state)
+    {
+        JitProfiler profiler(mState, { .mInterval = 1ms });
+        profiler.start();
+        run(0.2);
+        profiler.stop();
+        const JitSampleCounts& totals = profiler.getSampleCounts();
+        EXPECT_GT(totals[static_cast<std::size_t>(JitVmState::Compiled)], 0);
+
+        const std::vector<JitProfileEntry> summary = profiler.getSummary();
+        ASSERT_FALSE(summary.empty());
+        EXPECT_EQ(summary.front().mLocation, "busy:2");
+        const std::string folded = profiler.getFoldedStacks();
+        EXPECT_NE(folded.find("busy:2;[compiled] "), std::string::npos) << folded;
+
+        profiler.clear();
+        EXPECT_TRUE(profiler.getFoldedStacks().empty());
+        EXPECT_TRUE(profiler.getSummary().empty());
+    }
+
+    TEST_F(JitProfilerTest, interpreted_code_is_told_apart)
+    {
+        mState.withStack([](Stack& stack) { stack.execute("jit.off()"); });
+        JitProfiler profiler(mState, { .mInterval = 1ms, .mLines = true });
+        profiler.start();
+        run(0.1);
+        profiler.stop();
+        const JitSampleCounts& totals = profiler.getSampleCounts();
+        EXPECT_GT(totals[static_cast<std::size_t>(JitVmState::Interpreted)], 0);
+        EXPECT_EQ(totals[static_cast<std::size_t>(JitVmState::Compiled)], 0);
+        EXPECT_NE(profiler.getFoldedStacks().find("busy:5;[interpreted] "), std::string::npos);
+    }
+
+    TEST_F(JitProfilerTest, only_one_profiler_can_run)
+    {
+        JitProfiler first(mState);
+        JitProfiler second(mState);
+        first.start();
+        EXPECT_THROW(second.start(), std::logic_error);
+        first.stop();
+        EXPECT_NO_THROW(second.start());
+    }
+#else
+    TEST(JitProfilerTest, requires_luajit)
+    {
+        State state;
+        JitProfiler profiler(state);
+        EXPECT_THROW(profiler.start(), std::runtime_error);
+    }
+#endif
+}
@@ -1,9 +1,16 @@
+#include <coroutine.hpp>
+#include <exception.hpp>
 #include <stack.hpp>
 #include <state.hpp>
 
 #include <lua.hpp>
+#include <lua/enums.hpp>
 
 #include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -56,6 +63,11 @@ namespace
         }));
     }
 
+    TEST_F(MemoryTest, can_get_allocator_data)
+    {
+        mState.withStack([&](Stack& stack) { EXPECT_EQ(stack.getAllocatorData(), &mData); });
+    }
+
     TEST_F(MemoryTest, exceeding_max_stack_throws)
     {
         EXPECT_ANY_THROW(mState.withStack([&](Stack& stack) { stack.ensure(LUAI_MAXCSTACK + 1); }));
@@ -66,4 +78,187 @@ namespace
         AllocatorData data{ .mBlock = true };
         EXPECT_THROW(State(allocate, &data), std::bad_alloc);
     }
+
+    TEST(MemoryLimitTest, hard_limit_throws_memory_error)
+    {
+        State state;
+        state.loadLibraries();
+        state.setMemoryLimits({ .mHard = state.getMemoryUsed() + 512 * 1024 });
+        state.withStack([](Stack& stack) {
+            EXPECT_THROW(stack.execute("local t = {} for i = 1, 10000000 do t[i] = i end"), MemoryError);
+            // The table is garbage now, so the state can carry on
+            stack.collectGarbage();
+            EXPECT_EQ(stack.execute<int>("local t = {} for i = 1, 1000 do t[i] = i end return #t"), 1000);
+        });
+    }
+
+    TEST(MemoryLimitTest, limit_can_be_passed_to_the_constructor)
+    {
+        State state(MemoryLimits{ .mHard = 256 * 1024 });
+        state.withStack([](Stack& stack) {
+            EXPECT_THROW(stack.execute("local s = 'x' for i = 1, 20 do s = s .. s end"), MemoryError);
+        });
+        EXPECT_LE(state.getMemoryUsed(), 256 * 1024);
+    }
+
+    TEST(MemoryLimitTest, soft_limit_collects_garbage)
+    {
+        State state;
+        state.loadLibraries();
+        std::vector<std::size_t> reached;
+        const std::size_t soft = state.getMemoryUsed() + 256 * 1024;
+        state.setMemoryLimits({ .mSoft = soft, .mOnSoftLimit = [&](Stack&, std::size_t used) {
+                                   EXPECT_GT(used, soft);
+                                   reached.push_back(used);
+                               } });
+        state.withStack([&](Stack& stack) {
+            // The collector is stopped, so only the soft limit can clear the weak table
+            stack.execute(R"(
+                collectgarbage('stop')
+                weak = setmetatable({ {} }, { __mode = 'v' })
+                local garbage = {}
+                for i = 1, 100000 do garbage[i] = {} end
+            )");
+            EXPECT_FALSE(reached.empty());
+            EXPECT_TRUE(stack.execute<bool>("return weak[1] == nil"));
+        });
+    }
+
+    TEST(MemoryLimitTest, soft_limit_is_reached_in_coroutines)
+    {
+        State state;
+        state.loadLibraries();
+        std::size_t reached = 0;
+        state.setMemoryLimits({ .mSoft = state.getMemoryUsed() + 256 * 1024,
+            .mOnSoftLimit = [&](Stack&, std::size_t) { ++reached; } });
+        state.withStack([&](Stack& stack) {
+            Coroutine coroutine = stack.pushCoroutine(stack.pushFunction(R"(
+                collectgarbage('stop')
+                local weak = setmetatable({ {} }, { __mode = 'v' })
+                local garbage = {}
+                for i = 1, 100000 do garbage[i] = {} end
+                coroutine.yield(weak[1] == nil)
+            )"));
+            EXPECT_TRUE(coroutine.resume<bool>());
+            EXPECT_GT(reached, 0);
+        });
+    }
+
+    TEST(MemoryLimitTest, soft_limit_does_not_call_count_hook_early)
+    {
+        constexpr const char* script = R"(
+            if jit then jit.off() end
+            local garbage = {}
+            for i = 1, 100000 do garbage[i % 1000] = { i } end
+        )";
+        const auto countHookCalls = [&](int count, bool limit) {
+            State state;
+            state.loadLibraries();
+            int calls = 0;
+            std::size_t reached = 0;
+            state.setDebugHook([&](Stack&, lua_Debug&) { ++calls; }, LuaHookMask::Count, count);
+            if (limit)
+                state.setMemoryLimits(
+                    { .mSoft = state.getMemoryUsed() + 64 * 1024, .mOnSoftLimit = [&](Stack&, std::size_t) { ++reached; } });
+            state.withStack([&](Stack& stack) { stack.execute(script); });
+            EXPECT_EQ(reached > 0, limit);
+            return calls;
+        };
+        // The script is far shorter than the interval
+        EXPECT_EQ(countHookCalls(std::numeric_limits<int>::max(), true), 0);
+        const int calls = countHookCalls(1000, false);
+        EXPECT_GT(calls, 100);
+        EXPECT_LE(countHookCalls(1000, true), calls);
+    }
+
+    TEST(MemoryAttributionTest, allocations_are_charged_to_the_current_owner)
+    {
+        State state;
+        state.loadLibraries();
+        state.setMemoryAttribution(true);
+        state.withStack([](Stack& stack) {
+            stack["allocateFor"] = [](Stack& s, MemoryOwner owner, std::string_view name) {
+                MemoryOwnerScope scope(s, owner);
+                s.execute(std::string(name) + " = {} for i = 1, 1000 do " + std::string(name) + "[i] = { i } end");
+            };
+            {
+                MemoryOwnerScope scope(stack, 1);
+                stack.execute("small = { 1, 2, 3 }");
+            }
+            stack.execute("allocateFor(2, 'large')");
+        });
+        const MemoryOwnerStats small = state.getMemoryOwnerStats(1);
+        const MemoryOwnerStats large = state.getMemoryOwnerStats(2);
+        EXPECT_GT(small.mLiveBytes, 0);
+        EXPECT_GT(large.mLiveBytes, small.mLiveBytes * 10);
+        EXPECT_GT(large.mAllocations, 1000);
+        EXPECT_GE(large.mAllocatedBytes, large.mLiveBytes);
+        EXPECT_EQ(state.getMemoryOwnerStats(3).mAllocations, 0);
+
+        std::size_t total = 0;
+        const std::vector<MemoryOwnerStats> owners = state.getMemoryOwnerStats();
+        ASSERT_EQ(owners.size(), 3);
+        for (const MemoryOwnerStats& owner : owners)
+            total += owner.mLiveBytes;
+        EXPECT_EQ(total, state.getMemoryUsed());
+    }
+
+    TEST(MemoryAttributionTest, frees_are_credited_to_the_allocating_owner)
+    {
+        State state;
+        state.setMemoryAttribution(true);
+        state.withStack([](Stack& stack) {
+            MemoryOwnerScope scope(stack, 1);
+            stack.execute("garbage = {} for i = 1, 1000 do garbage[i] = { i } end");
+        });
+        const std::size_t allocated = state.getMemoryOwnerStats(1).mLiveBytes;
+        state.withStack([](Stack& stack) {
+            MemoryOwnerScope scope(stack, 2);
+            stack.execute("garbage = nil");
+            stack.collectGarbage();
+        });
+        EXPECT_LT(state.getMemoryOwnerStats(1).mLiveBytes, allocated / 10);
+        state.setMemoryAttribution(false);
+        EXPECT_TRUE(state.getMemoryOwnerStats().empty());
+    }
+
+    TEST(MemoryAttributionTest, coroutines_are_charged_to_their_owner)
+    {
+        State state;
+        state.loadLibraries();
+        state.setMemoryAttribution(true);
+        state.withStack([](Stack& stack) {
+            FunctionView body = stack.pushFunction("garbage = {} for i = 1, 1000 do garbage[i] = { i } end");
+            Coroutine owned = stack.pushCoroutine(body);
+            owned.setMemoryOwner(1);
+            Coroutine inherited = [&] {
+                MemoryOwnerScope scope(stack, 2);
+                return stack.pushCoroutine(stack.pushFunction("kept = {} for i = 1, 1000 do kept[i] = { i } end"));
+            }();
+            MemoryOwnerScope scope(stack, 3);
+            owned.resume();
+            inherited.resume();
+        });
+        EXPECT_GT(state.getMemoryOwnerStats(1).mAllocations, 1000);
+        EXPECT_GT(state.getMemoryOwnerStats(2).mAllocations, 1000);
+        EXPECT_LT(state.getMemoryOwnerStats(3).mAllocations, 100);
+    }
+
+    TEST(MemoryAttributionTest, owned_functions_charge_their_owner)
+    {
+        State state;
+        state.loadLibraries();
+        state.setMemoryAttribution(true);
+        state.withStack([](Stack& stack) {
+            FunctionView chunk = stack.pushFunction("owned = {} for i = 1, 1000 do owned[i] = { i } end");
+            stack["callback"] = stack.pushOwnedFunction(chunk, 1);
+            stack["failing"] = stack.pushOwnedFunction(stack.pushFunction("t = { 1 } error('failed')"), 2);
+            stack.execute("callback()");
+            EXPECT_THROW(stack.execute("failing()"), std::runtime_error);
+            stack.execute("after = {} for i = 1, 1000 do after[i] = { i } end");
+        });
+        EXPECT_GT(state.getMemoryOwnerStats(1).mAllocations, 1000);
+        EXPECT_GT(state.getMemoryOwnerStats(2).mAllocations, 0);
+        EXPECT_LT(state.getMemoryOwnerStats(2).mAllocations, 100);
+    }
 }
@@ -0,0 +1,83 @@
+#include <parallel.hpp>
+#include <state.hpp>
+#include <statepool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    struct ParallelTest : public testing::Test
+    {
+        StatePool mPool;
+
+        static StateRecipe makeRecipe()
+        {
+            StateRecipe recipe;
+            recipe.mLibraries = std::vector{ Library::Base };
+            recipe.mChunks.push_back({ R"(
+                function square(x) return x * x end
+                function isEven(x) return x % 2 == 0 end
+                function check(x) if x == 777 then error('bad record') end return x end
+            )", "rules" });
+            return recipe;
+        }
+
+        ParallelTest()
+            : mPool(makeRecipe(), 4)
+        {
+        }
+    };
+
+    TEST_F(ParallelTest, results_keep_input_order)
+    {
+        std::vector<int> inputs(10000);
+        std::iota(inputs.begin(), inputs.end(), 0);
+        const std::vector<long long> squares = parallelMap<long long>(mPool, "square", std::span<const int>(inputs), 64);
+        ASSERT_EQ(squares.size(), inputs.size());
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+            EXPECT_EQ(squares[i], static_cast<long long>(i * i));
+        EXPECT_EQ(mPool.getStats().mAvailable, 4);
+    }
+
+    TEST_F(ParallelTest, can_map_to_booleans)
+    {
+        std::vector<int> inputs(1001);
+        std::iota(inputs.begin(), inputs.end(), 0);
+        const std::vector<bool> even = parallelMap<bool>(mPool, "isEven", std::span<const int>(inputs), 10);
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+            EXPECT_EQ(even[i], i % 2 == 0);
+    }
+
+    TEST_F(ParallelTest, can_map_with_chunks)
+    {
+        const std::vector<std::string> inputs{ "a", "bb", "ccc" };
+        const std::vector<std::string> outputs = parallelMapChunk<std::string>(
+            mPool, "return function(s) return s .. '!' end", std::span<const std::string>(inputs), 1);
+        EXPECT_EQ(outputs, (std::vector<std::string>{ "a!", "bb!", "ccc!" }));
+    }
+
+    TEST_F(ParallelTest, can_reduce)
+    {
+        std::vector<int> inputs(1000);
+        std::iota(inputs.begin(), inputs.end(), 1);
+        const long long sum = parallelReduce<long long>(
+            mPool, "square", std::span<const int>(inputs), 0LL, [](long long a, long long b) { return a + b; });
+        EXPECT_EQ(sum, 333833500LL);
+    }
+
+    TEST_F(ParallelTest, errors_are_rethrown)
+    {
+        std::vector<int> inputs(1000);
+        std::iota(inputs.begin(), inputs.end(), 0);
+        EXPECT_THROW(parallelMap<int>(mPool, "check", std::span<const int>(inputs), 16), std::runtime_error);
+        EXPECT_EQ(mPool.getStats().mAvailable, 4);
+        EXPECT_TRUE(parallelMap<int>(mPool, "check", std::span<const int>(inputs.data(), 0)).empty());
+    }
+}
@@ -0,0 +1,114 @@
+#include <poolallocator.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+#include <statepool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    constexpr const char* tableHeavyScript = R"(
+        local t = {}
+        for i = 1, 2000 do t[i] = { i, tostring(i), x = i } end
+        local sum = 0
+        for i = 1, #t do sum = sum + t[i].x end
+        return sum
+    )";
+
+    void* allocate(PoolAllocator& allocator, void* pointer, std::size_t oldSize, std::size_t newSize)
+    {
+        return PoolAllocator::allocate(&allocator, pointer, oldSize, newSize);
+    }
+
+    TEST(PoolAllocatorTest, small_blocks_stay_in_their_size_class)
+    {
+        PoolAllocator allocator;
+        void* block = allocate(allocator, nullptr, 0, 20);
+        ASSERT_NE(block, nullptr);
+        std::memcpy(block, "0123456789", 10);
+        EXPECT_EQ(allocate(allocator, block, 20, 32), block);
+        EXPECT_EQ(allocate(allocator, block, 32, 17), block);
+        void* moved = allocate(allocator, block, 17, 100);
+        EXPECT_EQ(std::memcmp(moved, "0123456789", 10), 0);
+        // The freed block is reused
+        EXPECT_EQ(allocate(allocator, nullptr, 0, 24), block);
+        EXPECT_EQ(allocator.getStats().mSlabCount, 2);
+        EXPECT_EQ(allocate(allocator, moved, 100, 0), nullptr);
+        EXPECT_EQ(allocate(allocator, block, 24, 0), nullptr);
+        EXPECT_EQ(allocator.getStats().mLargeCount, 0);
+    }
+
+    TEST(PoolAllocatorTest, large_blocks_use_malloc)
+    {
+        PoolAllocator allocator;
+        void* block = allocate(allocator, nullptr, 0, 100);
+        std::memcpy(block, "abc", 4);
+        block = allocate(allocator, block, 100, 1000);
+        EXPECT_STREQ(static_cast<const char*>(block), "abc");
+        PoolAllocatorStats stats = allocator.getStats();
+        EXPECT_EQ(stats.mLargeCount, 1);
+        EXPECT_EQ(stats.mLargeBytes, 1000);
+        block = allocate(allocator, block, 1000, 4000);
+        EXPECT_EQ(allocator.getStats().mLargeBytes, 4000);
+        block = allocate(allocator, block, 4000, 8);
+        EXPECT_STREQ(static_cast<const char*>(block), "abc");
+        stats = allocator.getStats();
+        EXPECT_EQ(stats.mLargeCount, 0);
+        EXPECT_EQ(stats.mLargeBytes, 0);
+        allocate(allocator, block, 8, 0);
+    }
+
+    TEST(PoolAllocatorTest, can_back_a_state)
+    {
+        PoolAllocator allocator;
+        {
+            State state(&PoolAllocator::allocate, &allocator);
+            state.loadLibraries();
+            state.withStack([](Stack& stack) { EXPECT_EQ(stack.execute<int>(tableHeavyScript), 2001000); });
+            EXPECT_GT(allocator.getStats().mSlabCount, 0);
+        }
+        EXPECT_EQ(allocator.getStats().mLargeCount, 0);
+    }
+
+    TEST(PoolAllocatorTest, can_be_shared_across_threads_with_the_thread_cache)
+    {
+        PoolAllocator allocator(true);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&] {
+                State state(&PoolAllocator::allocate, &allocator);
+                state.loadLibraries();
+                for (int round = 0; round < 3; ++round)
+                    state.withStack([](Stack& stack) { EXPECT_EQ(stack.execute<int>(tableHeavyScript), 2001000); });
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        EXPECT_EQ(allocator.getStats().mLargeCount, 0);
+    }
+
+    TEST(PoolAllocatorTest, state_pools_can_share_an_allocator)
+    {
+        PoolAllocator allocator(true);
+        StateRecipe recipe;
+        recipe.mAllocator = &allocator;
+        recipe.mChunks.push_back({ "value = 42", "" });
+        {
+            StatePool pool(recipe, 2);
+            StatePool::Handle handle = pool.checkout();
+            handle->withStack([](Stack& stack) { EXPECT_EQ(stack.execute<int>("return value"), 42); });
+            EXPECT_GT(allocator.getStats().mSlabCount, 0);
+        }
+        PoolAllocator unsafe;
+        recipe.mAllocator = &unsafe;
+        EXPECT_THROW(StatePool(recipe, 2), std::invalid_argument);
+    }
+}
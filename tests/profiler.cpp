@@ -0,0 +1,121 @@
+#include <lua/enums.hpp>
+#include <profiler.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+namespace
+{
+    using namespace lat;
+    using namespace std::chrono_literals;
+
+    // Compiled traces do not run hooks, so keep everything in the interpreter
+    constexpr const char* busyScript = R"(
+        if jit then jit.off() end
+        function inner(n)
+            local s = 0
+            for i = 1, n do s = s + i % 7 end
+            return s
+        end
+        function outer(seconds)
+            local start = os.clock()
+            while os.clock() - start < seconds do inner(1000) end
+        end
+    )";
+
+    struct ProfilerTest : public testing::Test
+    {
+        State mState;
+
+        ProfilerTest()
+        {
+            mState.loadLibraries();
+            mState.withStack([](Stack& stack) { stack.pushFunction(busyScript, "=busy")(); });
+        }
+
+        void run(double seconds)
+        {
+            mState.withStack([&](Stack& stack) {
+                FunctionView outer = stack["outer"];
+                outer(seconds);
+                stack.pop();
+            });
+        }
+    };
+
+    TEST_F(ProfilerTest, samples_running_code)
+    {
+        Profiler profiler(mState, { .mInterval = 1ms });
+        profiler.start();
+        run(0.2);
+        profiler.stop();
+        EXPECT_GT(profiler.getSampleCount(), 5);
+        EXPECT_EQ(profiler.getDroppedCount(), 0);
+        const std::string folded = profiler.getFoldedStacks();
+        // outer is called from C++, so Lua cannot name it
+        EXPECT_NE(folded.find("? (busy:8);inner (busy:3) "), std::string::npos) << folded;
+
+        const std::size_t count = profiler.getSampleCount();
+        run(0.05);
+        EXPECT_EQ(profiler.getSampleCount(), count);
+        profiler.clear();
+        EXPECT_TRUE(profiler.getFoldedStacks().empty());
+    }
+
+    TEST_F(ProfilerTest, keeps_the_latest_samples)
+    {
+        Profiler profiler(mState, { .mInterval = 1ms, .mCapacity = 4, .mMaxDepth = 1 });
+        profiler.start();
+        run(0.2);
+        profiler.stop();
+        EXPECT_EQ(profiler.getSampleCount(), 4);
+        EXPECT_GT(profiler.getDroppedCount(), 0);
+        // Only the innermost frame is kept
+        EXPECT_EQ(profiler.getFoldedStacks().find(';'), std::string::npos);
+    }
+
+    TEST_F(ProfilerTest, does_not_call_count_hook_early)
+    {
+        const auto countHookCalls = [&](int count, bool profile) {
+            int calls = 0;
+            mState.setDebugHook([&](Stack&, lua_Debug&) { ++calls; }, LuaHookMask::Count, count);
+            Profiler profiler(mState, { .mInterval = 1ms });
+            if (profile)
+                profiler.start();
+            mState.withStack([](Stack& stack) {
+                FunctionView inner = stack["inner"];
+                for (int i = 0; i < 200; ++i)
+                    inner(10000);
+                stack.pop();
+            });
+            profiler.stop();
+            mState.disableDebugHook();
+            EXPECT_EQ(profiler.getSampleCount() > 0, profile);
+            return calls;
+        };
+        EXPECT_EQ(countHookCalls(std::numeric_limits<int>::max(), true), 0);
+        const int calls = countHookCalls(10000, false);
+        EXPECT_GT(calls, 100);
+        const int profiledCalls = countHookCalls(10000, true);
+        // Sampling may postpone the hook, but never calls it before its interval elapsed
+        EXPECT_LE(profiledCalls, calls);
+        EXPECT_GT(profiledCalls, calls / 2);
+    }
+
+    TEST_F(ProfilerTest, only_one_profiler_can_run)
+    {
+        Profiler first(mState);
+        Profiler second(mState);
+        first.start();
+        EXPECT_THROW(second.start(), std::logic_error);
+        first.stop();
+        EXPECT_NO_THROW(second.start());
+    }
+}
+#endif
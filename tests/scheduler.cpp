@@ -0,0 +1,227 @@
+#include <scheduler.hpp>
+#include <stack.hpp>
+#include <state.hpp>
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    struct SchedulerTest : public testing::Test
+    {
+        State mState;
+        std::optional<Scheduler> mScheduler;
+        std::vector<std::string> mLog;
+
+        SchedulerTest()
+        {
+            mState.loadLibraries({ { Library::Base } });
+            mScheduler.emplace(mState);
+            mState.withStack([&](Stack& stack) {
+                mScheduler->registerFunctions(stack.globals());
+                stack["log"] = [&](std::string entry) { mLog.push_back(std::move(entry)); };
+            });
+        }
+
+        ~SchedulerTest() { mScheduler.reset(); }
+
+        TaskId spawn(std::string_view lua)
+        {
+            TaskId id = 0;
+            mState.withStack([&](Stack& stack) {
+                id = mScheduler->spawn(stack.pushFunction(lua));
+                stack.pop();
+            });
+            return id;
+        }
+    };
+
+    TEST_F(SchedulerTest, runs_tasks_until_they_finish)
+    {
+        const TaskId id = spawn("log('a') coroutine.yield() log('b')");
+        EXPECT_TRUE(mScheduler->isAlive(id));
+        EXPECT_EQ(mScheduler->tick(0.), 1);
+        EXPECT_EQ(mLog, std::vector<std::string>{ "a" });
+        EXPECT_EQ(mScheduler->tick(0.), 1);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "a", "b" }));
+        EXPECT_FALSE(mScheduler->isAlive(id));
+        EXPECT_EQ(mScheduler->getTaskCount(), 0);
+        EXPECT_EQ(mScheduler->tick(0.), 0);
+    }
+
+    TEST_F(SchedulerTest, sleeping_tasks_are_not_resumed)
+    {
+        spawn("sleep(1.5) log('slept')");
+        spawn("sleepUntil(1) log('until')");
+        EXPECT_EQ(mScheduler->tick(0.), 2);
+        EXPECT_EQ(mScheduler->tick(0.5), 0);
+        EXPECT_TRUE(mLog.empty());
+        EXPECT_EQ(mScheduler->tick(1.), 1);
+        EXPECT_EQ(mLog, std::vector<std::string>{ "until" });
+        EXPECT_EQ(mScheduler->tick(2.), 1);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "until", "slept" }));
+        EXPECT_EQ(mScheduler->getTaskCount(), 0);
+    }
+
+    TEST_F(SchedulerTest, can_wait_for_frames)
+    {
+        spawn("waitFrames(2) log('frames')");
+        spawn("waitUntilFrame(5) log('frame')");
+        mScheduler->tick(0.);
+        EXPECT_EQ(mScheduler->getFrame(), 1);
+        mScheduler->tick(0.);
+        EXPECT_TRUE(mLog.empty());
+        mScheduler->tick(0.);
+        EXPECT_EQ(mLog, std::vector<std::string>{ "frames" });
+        mScheduler->tick(0.);
+        EXPECT_EQ(mLog.size(), 1);
+        mScheduler->tick(0.);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "frames", "frame" }));
+    }
+
+    TEST_F(SchedulerTest, can_wait_for_signals)
+    {
+        spawn("wait('door') log('first')");
+        spawn("wait('door') log('second')");
+        spawn("wait('window') log('third')");
+        mScheduler->tick(0.);
+        EXPECT_EQ(mScheduler->tick(1.), 0);
+        mScheduler->signal("door");
+        EXPECT_EQ(mScheduler->tick(2.), 2);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "first", "second" }));
+        mScheduler->signal("door");
+        EXPECT_EQ(mScheduler->tick(3.), 0);
+        EXPECT_EQ(mScheduler->getTaskCount(), 1);
+    }
+
+    TEST_F(SchedulerTest, budget_limits_resumes_per_tick)
+    {
+        for (int i = 0; i < 5; ++i)
+            spawn("log('a') coroutine.yield() log('b')");
+        mScheduler->setResumeBudget(3);
+        EXPECT_EQ(mScheduler->tick(0.), 3);
+        EXPECT_EQ(mScheduler->tick(0.), 3);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "a", "a", "a", "a", "a", "b" }));
+        EXPECT_EQ(mScheduler->tick(0.), 3);
+        EXPECT_EQ(mScheduler->tick(0.), 1);
+        EXPECT_EQ(mScheduler->getTaskCount(), 0);
+    }
+
+    TEST_F(SchedulerTest, cancelled_tasks_are_dropped)
+    {
+        const TaskId sleeping = spawn("sleep(1) log('sleeping')");
+        const TaskId ready = spawn("log('ready')");
+        mScheduler->cancel(ready);
+        EXPECT_EQ(mScheduler->tick(0.), 1);
+        mScheduler->cancel(sleeping);
+        EXPECT_EQ(mScheduler->tick(2.), 0);
+        EXPECT_TRUE(mLog.empty());
+        EXPECT_EQ(mScheduler->getTaskCount(), 0);
+        EXPECT_NE(spawn("log('new')"), sleeping);
+    }
+
+    TEST_F(SchedulerTest, cancelled_waits_do_not_wake_new_tasks)
+    {
+        std::vector<TaskId> cancelled;
+        for (int i = 0; i < 8; ++i)
+        {
+            cancelled.push_back(spawn("sleep(100) log('sleeping')"));
+            cancelled.push_back(spawn("waitFrames(100) log('frames')"));
+            cancelled.push_back(spawn("wait('never') log('never')"));
+        }
+        spawn("sleep(1) log('slept')");
+        spawn("wait('door') log('door')");
+        mScheduler->tick(0.);
+        for (TaskId id : cancelled)
+            mScheduler->cancel(id);
+        EXPECT_EQ(mScheduler->getTaskCount(), 2);
+        // New tasks take over the slots of the cancelled ones
+        for (int i = 0; i < 8; ++i)
+            spawn("wait('never') log('new')");
+        mScheduler->tick(0.);
+        mScheduler->signal("door");
+        mScheduler->signal("never");
+        for (int frame = 0; frame < 100; ++frame)
+            mScheduler->tick(200.);
+        EXPECT_EQ(mLog, (std::vector<std::string>{ "door", "new", "new", "new", "new", "new", "new", "new", "new",
+                            "slept" }));
+        EXPECT_EQ(mScheduler->getTaskCount(), 0);
+    }
+
+    TEST_F(SchedulerTest, errors_remove_tasks)
+    {
+        const TaskId failing = spawn("coroutine.yield() error('failed')");
+        spawn("coroutine.yield() coroutine.yield() log('done')");
+        mScheduler->tick(0.);
+        EXPECT_THROW(mScheduler->tick(0.), std::runtime_error);
+        EXPECT_FALSE(mScheduler->isAlive(failing));
+        std::vector<TaskId> failed;
+        mScheduler->setErrorHandler([&](TaskId id, std::string_view) { failed.push_back(id); });
+        const TaskId other = spawn("sleep('soon')");
+        mScheduler->tick(0.);
+        mScheduler->tick(0.);
+        EXPECT_EQ(failed, std::vector<TaskId>{ other });
+        EXPECT_EQ(mLog, std::vector<std::string>{ "done" });
+    }
+
+    TEST_F(SchedulerTest, finished_tasks_are_recycled)
+    {
+        mState.setCoroutinePoolCapacity(4);
+        mScheduler->setRecycling(true);
+        for (int round = 0; round < 3; ++round)
+        {
+            for (int i = 0; i < 4; ++i)
+                spawn("log('run')");
+            EXPECT_EQ(mScheduler->tick(0.), 4);
+        }
+        EXPECT_EQ(mLog.size(), 12);
+        const CoroutinePoolStats stats = mState.getCoroutinePoolStats();
+        EXPECT_EQ(stats.mCreated, 4);
+        EXPECT_EQ(stats.mReused, 8);
+        EXPECT_EQ(stats.mSize, 4);
+    }
+
+    TEST_F(SchedulerTest, tasks_are_charged_to_the_owner_that_spawned_them)
+    {
+        mState.setMemoryAttribution(true);
+        mState.withStack([&](Stack& stack) {
+            MemoryOwnerScope scope(stack, 1);
+            mScheduler->spawn(stack.pushFunction("coroutine.yield() t = {} for i = 1, 1000 do t[i] = { i } end"));
+            stack.pop();
+        });
+        mScheduler->tick(0.);
+        const std::size_t allocations = mState.getMemoryOwnerStats(1).mAllocations;
+        mScheduler->tick(0.);
+        EXPECT_GT(mState.getMemoryOwnerStats(1).mAllocations, allocations + 1000);
+        EXPECT_LT(mState.getMemoryOwnerStats(defaultMemoryOwner).mAllocations, 100);
+    }
+
+    TEST_F(SchedulerTest, recycling_is_disabled_by_default)
+    {
+        mState.setCoroutinePoolCapacity(4);
+        EXPECT_FALSE(mScheduler->isRecycling());
+        spawn("log('run')");
+        mScheduler->tick(0.);
+        EXPECT_EQ(mState.getCoroutinePoolStats().mSize, 0);
+    }
+
+    TEST_F(SchedulerTest, cannot_wait_outside_of_tasks)
+    {
+        mState.withStack([](Stack& stack) { EXPECT_THROW(stack.execute("sleep(1)"), std::runtime_error); });
+    }
+
+    TEST_F(SchedulerTest, cannot_wait_once_destroyed)
+    {
+        mScheduler.reset();
+        mState.withStack([](Stack& stack) {
+            EXPECT_EQ(stack.execute<std::string>("return select(2, pcall(sleep, 1))"), "scheduler destroyed");
+            EXPECT_THROW(stack.execute("wait('door')"), std::runtime_error);
+        });
+    }
+}
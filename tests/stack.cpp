@@ -22,6 +22,15 @@ namespace
         });
     }
 
+    TEST_F(StackTest, globals_start_empty)
+    {
+        mState.withStack([](Stack& stack) {
+            std::size_t count = 0;
+            stack.globals().forEach([&](ObjectView, ObjectView) { ++count; });
+            EXPECT_EQ(count, 0);
+        });
+    }
+
     TEST_F(StackTest, can_push_and_pop)
     {
         mState.withStack([](Stack& stack) {
@@ -216,4 +225,61 @@ namespace
             EXPECT_EQ(stack.getTop(), 2);
         });
     }
+
+    TEST_F(StackTest, chunks_are_not_cached_by_default)
+    {
+        mState.withStack([](Stack& stack) {
+            FunctionView first = stack.pushFunction("return 1");
+            FunctionView second = stack.pushFunction("return 1");
+            EXPECT_FALSE(stack.same(first.getIndex(), second.getIndex()));
+        });
+        const ChunkCacheStats stats = mState.getChunkCacheStats();
+        EXPECT_EQ(stats.mHits, 0);
+        EXPECT_EQ(stats.mMisses, 0);
+    }
+
+    TEST_F(StackTest, can_cache_chunks)
+    {
+        mState.setChunkCacheCapacity(2);
+        mState.withStack([](Stack& stack) {
+            FunctionView first = stack.pushFunction("return 1");
+            FunctionView second = stack.pushFunction("return 1");
+            EXPECT_FALSE(stack.same(first.getIndex(), second.getIndex()));
+            FunctionView named = stack.pushFunction("return 1", "named");
+            EXPECT_FALSE(stack.same(first.getIndex(), named.getIndex()));
+            EXPECT_EQ(stack.execute<int>("return 1"), 1);
+            stack.pop(3);
+        });
+        ChunkCacheStats stats = mState.getChunkCacheStats();
+        EXPECT_EQ(stats.mHits, 2);
+        EXPECT_EQ(stats.mMisses, 2);
+        EXPECT_EQ(stats.mSize, 2);
+        mState.withStack([](Stack& stack) {
+            // Evicts "return 1" named "named", the least recently used entry
+            stack.pushFunction("return 2");
+            stack.pushFunction("return 1", "named");
+            stack.pop(2);
+        });
+        stats = mState.getChunkCacheStats();
+        EXPECT_EQ(stats.mMisses, 4);
+        EXPECT_EQ(stats.mSize, 2);
+        mState.clearChunkCache();
+        EXPECT_EQ(mState.getChunkCacheStats().mSize, 0);
+    }
+
+    TEST_F(StackTest, cached_chunks_have_their_own_environment)
+    {
+        mState.setChunkCacheCapacity(1);
+        mState.withStack([](Stack& stack) {
+            stack["value"] = 1;
+            FunctionView first = stack.pushFunction("return value");
+            TableView environment = stack.pushTable();
+            environment["value"] = 2;
+            EXPECT_TRUE(first.setEnvironment(environment));
+            FunctionView second = stack.pushFunction("return value");
+            EXPECT_EQ(second.invoke<int>(), 1);
+            EXPECT_EQ(first.invoke<int>(), 2);
+        });
+        EXPECT_EQ(mState.getChunkCacheStats().mHits, 1);
+    }
 }
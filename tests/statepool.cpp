@@ -0,0 +1,123 @@
+#include <stack.hpp>
+#include <state.hpp>
+#include <statepool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <optional>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using namespace lat;
+
+    struct Vec2
+    {
+        int mX;
+        int mY;
+    };
+
+    StateRecipe makeRecipe()
+    {
+        StateRecipe recipe;
+        recipe.mLibraries = std::vector{ Library::Base, Library::Math };
+        recipe.mSetUp = [](Stack& stack) {
+            auto type = stack.newUserType<Vec2>("Vec2");
+            type.setReadOnlyProperty("x", [](const Vec2& v) { return v.mX; });
+            type.setReadOnlyProperty("y", [](const Vec2& v) { return v.mY; });
+            stack["vec2"] = [](int x, int y) { return Vec2{ x, y }; };
+        };
+        recipe.mChunks.push_back({ "function length(v) return math.abs(v.x) + math.abs(v.y) end", "length" });
+        recipe.mChunks.push_back({ "calls = 0", "" });
+        return recipe;
+    }
+
+    TEST(StatePoolTest, every_state_follows_the_recipe)
+    {
+        StatePool pool(makeRecipe(), 3);
+        EXPECT_EQ(pool.size(), 3);
+        std::vector<StatePool::Handle> handles;
+        for (std::size_t i = 0; i < pool.size(); ++i)
+        {
+            handles.push_back(pool.checkout());
+            handles.back()->withStack([](Stack& stack) {
+                EXPECT_EQ(stack.execute<int>("calls = calls + 1 return length(vec2(3, -4))"), 7);
+                EXPECT_EQ(stack.execute<int>("return calls"), 1);
+            });
+        }
+        std::set<std::size_t> indices;
+        for (const auto& handle : handles)
+            indices.insert(handle.getIndex());
+        EXPECT_EQ(indices.size(), 3);
+    }
+
+    TEST(StatePoolTest, handles_check_states_back_in)
+    {
+        StatePool pool(makeRecipe(), 1);
+        {
+            StatePool::Handle handle = pool.checkout();
+            EXPECT_FALSE(pool.tryCheckout());
+            StatePool::Handle moved = std::move(handle);
+            EXPECT_FALSE(pool.tryCheckout());
+            EXPECT_EQ(pool.getStats().mAvailable, 0);
+        }
+        std::optional<StatePool::Handle> handle = pool.tryCheckout();
+        ASSERT_TRUE(handle);
+        handle->reset();
+        EXPECT_TRUE(pool.tryCheckout());
+        const StatePoolStats stats = pool.getStats();
+        EXPECT_EQ(stats.mSize, 1);
+        EXPECT_EQ(stats.mAvailable, 1);
+        EXPECT_EQ(stats.mCheckouts, 3);
+    }
+
+    TEST(StatePoolTest, threads_get_their_last_state_with_affinity)
+    {
+        StatePool pool(makeRecipe(), 2, true);
+        StatePool::Handle first = pool.checkout();
+        StatePool::Handle second = pool.checkout();
+        const std::size_t last = second.getIndex();
+        second.reset();
+        first.reset();
+        for (int i = 0; i < 3; ++i)
+            EXPECT_EQ(pool.checkout().getIndex(), last);
+        std::thread([&] { pool.checkout(); }).join();
+        EXPECT_EQ(pool.checkout().getIndex(), last);
+        EXPECT_EQ(pool.getStats().mAffinityHits, 4);
+    }
+
+    TEST(StatePoolTest, states_can_be_shared_between_threads)
+    {
+        StatePool pool(makeRecipe(), 2);
+        std::atomic<int> total = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 50; ++i)
+                {
+                    StatePool::Handle handle = pool.checkout();
+                    handle->withStack([&](Stack& stack) {
+                        total += stack.execute<int>("calls = calls + 1 return length(vec2(1, 1))");
+                    });
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        EXPECT_EQ(total, 400);
+        int calls = 0;
+        std::vector<StatePool::Handle> handles;
+        for (std::size_t i = 0; i < pool.size(); ++i)
+        {
+            handles.push_back(pool.checkout());
+            handles.back()->withStack([&](Stack& stack) { calls += stack.execute<int>("return calls"); });
+        }
+        EXPECT_EQ(calls, 200);
+        EXPECT_EQ(pool.getStats().mCheckouts, 202);
+    }
+}
@@ -42,6 +42,17 @@ namespace
         });
     }
 
+    TEST_F(TableTest, setting_nested_values_leaves_the_stack_as_is)
+    {
+        mState.withStack([](Stack& stack) {
+            stack.execute("a = { b = { c = {} } }");
+            const int top = stack.getTop();
+            stack["a"]["b"]["c"]["d"] = 1;
+            EXPECT_EQ(top, stack.getTop());
+            EXPECT_EQ(stack["a"]["b"]["c"]["d"].get<int>(), 1);
+        });
+    }
+
     TEST_F(TableTest, indexing_into_a_non_table_throws)
     {
         mState.withStack([](Stack& stack) {
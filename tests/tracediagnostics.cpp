@@ -0,0 +1,142 @@
+#include <stack.hpp>
+#include <state.hpp>
+#include <tracediagnostics.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    using namespace lat;
+
+#ifdef LAT_LUAJIT
+    struct Counter
+    {
+        int mValue = 0;
+    };
+
+    struct TraceDiagnosticsTest : public testing::Test
+    {
+        State mState;
+
+        TraceDiagnosticsTest() { mState.loadLibraries(); }
+
+        void run(std::string_view script)
+        {
+            mState.withStack([&](Stack& stack) { stack.pushFunction(script, "=loop")(); });
+        }
+
+        const TraceIssue* find(const std::vector<TraceIssue>& issues, std::string_view function)
+        {
+            auto found = std::find_if(issues.begin(), issues.end(),
+                [&](const TraceIssue& issue) { return issue.mFunction == function; });
+            return found == issues.end() ? nullptr : &*found;
+        }
+    };
+
+    TEST_F(TraceDiagnosticsTest, attributes_stitches_to_bound_functions)
+    {
+        mState.withStack([](Stack& stack) { stack["bound"] = [](int x) { return x + 1; }; });
+        TraceDiagnostics diagnostics(mState);
+        diagnostics.start();
+        run(R"(
+            local s = 0
+            for i = 1, 1000 do
+                s = s + bound(i)
+            end
+        )");
+        diagnostics.stop();
+        const std::vector<TraceIssue> issues = diagnostics.getIssues();
+        const TraceIssue* issue = find(issues, "bound");
+        ASSERT_NE(issue, nullptr) << diagnostics.getReport();
+        EXPECT_EQ(issue->mLocation, "loop:4");
+        EXPECT_EQ(issue->mReason, "stitched around a C function");
+        EXPECT_GT(issue->mCount, 0);
+        EXPECT_GT(diagnostics.getTraceCount(), 0);
+        const std::vector<TraceCause> causes = diagnostics.getCauses();
+        ASSERT_FALSE(causes.empty());
+        EXPECT_EQ(causes.front().mReason, "stitched around a C function");
+
+        diagnostics.clear();
+        EXPECT_TRUE(diagnostics.getIssues().empty());
+        EXPECT_EQ(diagnostics.getTraceCount(), 0);
+    }
+
+    TEST_F(TraceDiagnosticsTest, names_user_type_members)
+    {
+        mState.withStack([](Stack& stack) {
+            auto type = stack.newUserType<Counter>("Counter");
+            type["increment"] = [](Counter& counter) { ++counter.mValue; };
+        });
+        Counter counter;
+        mState.withStack([&](Stack& stack) { stack["counter"] = &counter; });
+        TraceDiagnostics diagnostics(mState);
+        diagnostics.start();
+        run(R"(
+            for i = 1, 1000 do
+                counter:increment()
+            end
+        )");
+        diagnostics.stop();
+        EXPECT_EQ(counter.mValue, 1000);
+        EXPECT_NE(find(diagnostics.getIssues(), "Counter.increment"), nullptr) << diagnostics.getReport();
+    }
+
+    TEST_F(TraceDiagnosticsTest, ignores_traces_while_stopped)
+    {
+        mState.withStack([](Stack& stack) { stack["bound"] = [](int x) { return x + 1; }; });
+        TraceDiagnostics diagnostics(mState);
+        run(R"(
+            local s = 0
+            for i = 1, 1000 do
+                s = s + bound(i)
+            end
+        )");
+        EXPECT_TRUE(diagnostics.getIssues().empty());
+        EXPECT_EQ(diagnostics.getReport(), "0 traces compiled\n");
+    }
+
+    TEST(TraceDiagnosticsLibraryTest, requires_the_jit_library)
+    {
+        State state;
+        state.loadLibraries({ { Library::Base } });
+        EXPECT_THROW(TraceDiagnostics diagnostics(state), std::runtime_error);
+    }
+
+    TEST(TraceDiagnosticsLibraryTest, requires_the_base_library)
+    {
+        State state;
+        state.loadLibraries({ { Library::JIT } });
+        EXPECT_THROW(TraceDiagnostics diagnostics(state), std::runtime_error);
+    }
+
+    TEST(TraceDiagnosticsLibraryTest, does_not_depend_on_globals)
+    {
+        State state;
+        state.loadLibraries();
+        TraceDiagnostics diagnostics(state);
+        diagnostics.start();
+        state.withStack([](Stack& stack) {
+            stack["bound"] = [](int x) { return x + 1; };
+            stack.execute(R"(
+                pairs, type, setmetatable, string = nil, nil, nil, nil
+                local s = 0
+                for i = 1, 1000 do
+                    s = s + bound(i)
+                end
+            )");
+        });
+        diagnostics.stop();
+        EXPECT_FALSE(diagnostics.getIssues().empty()) << diagnostics.getReport();
+    }
+#else
+    TEST(TraceDiagnosticsTest, requires_luajit)
+    {
+        State state;
+        EXPECT_THROW(TraceDiagnostics diagnostics(state), std::runtime_error);
+    }
+#endif
+}
@@ -3,7 +3,10 @@
 
 #include <gtest/gtest.h>
 
-#include <cstring>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 
 namespace
 {
@@ -29,8 +32,8 @@ namespace
             ObjectView view = stack.push(pointer);
             EXPECT_TRUE(view.isUserData());
             std::span<std::byte> data = view.asUserData();
-            EXPECT_EQ(pointerSize, data.size());
-            EXPECT_EQ(std::memcmp(data.data(), &pointer, data.size()), 0);
+            EXPECT_LE(pointerSize, data.size());
+            EXPECT_EQ(view.as<const TestData*>(), pointer);
         });
     }
 
@@ -46,6 +49,21 @@ namespace
         });
     }
 
+    struct alignas(32) OverAlignedTestData
+    {
+        int mValue;
+    };
+
+    TEST_F(UserDataTest, can_push_overaligned_value_as_userdata)
+    {
+        mState.withStack([](Stack& stack) {
+            ObjectView view = stack.push(OverAlignedTestData{ 5 });
+            const auto* pointer = view.as<const OverAlignedTestData*>();
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pointer) % alignof(OverAlignedTestData), 0);
+            EXPECT_EQ(pointer->mValue, 5);
+        });
+    }
+
     TEST_F(UserDataTest, can_push_reference_wrapper)
     {
         mState.withStack([](Stack& stack) {
@@ -54,7 +72,7 @@ namespace
             ObjectView view = stack.push(wrapper);
             EXPECT_TRUE(view.isUserData());
             std::span<std::byte> data = view.asUserData();
-            EXPECT_EQ(pointerSize, data.size());
+            EXPECT_EQ(stack.push(&value).asUserData().size(), data.size());
         });
     }
 
@@ -130,6 +148,19 @@ namespace
         });
     }
 
+    TEST_F(UserDataTest, foreign_userdata_is_not_mistaken_for_a_usertype)
+    {
+        mState.withStack([](Stack& stack) {
+            const std::span<std::byte> data = stack.push(TestData{ 4 }).asUserData();
+            const std::span<std::byte> foreign = stack.pushUserData(data.size());
+            std::ranges::copy(data, foreign.begin());
+            ObjectView view = stack.getObject(-1);
+            EXPECT_FALSE(view.is<TestData>());
+            EXPECT_ANY_THROW(view.as<const TestData&>());
+            stack.pop(2);
+        });
+    }
+
     struct MoveOnlyTestData
     {
         int mValue;
@@ -163,6 +194,18 @@ namespace
         });
     }
 
+    TEST_F(UserDataTest, can_use_userdata_in_coroutines)
+    {
+        mState.loadLibraries({ { Library::Base } });
+        mState.withStack([](Stack& stack) {
+            stack["f"] = [](const TestData& data) { return TestData{ data.mValue + 1 }; };
+            stack["v"] = TestData{ 1 };
+            stack.execute("v = coroutine.wrap(function() return f(v) end)()");
+            TestData data = stack["v"];
+            EXPECT_EQ(data.mValue, 2);
+        });
+    }
+
     TEST_F(UserDataTest, can_define_bindings)
     {
         mState.withStack([](Stack& stack) {
@@ -376,4 +419,20 @@ namespace
             EXPECT_EQ(foo2, data.foo());
         });
     }
+
+    TEST_F(UserDataTest, can_use_indirect_base_types)
+    {
+        mState.withStack([](Stack& stack) {
+            stack.newUserType<DerivedDerivedTestData, DerivedTestData>("DerivedDerivedTestData");
+            stack.newUserType<DerivedTestData, TestData>("DerivedTestData");
+            DerivedDerivedTestData data(7);
+            ObjectView view = stack.push(&data);
+            EXPECT_TRUE(view.is<TestData>());
+            EXPECT_EQ(view.as<const TestData&>().mValue, data.mValue);
+            EXPECT_EQ(view.as<const DerivedTestData&>().foo(), data.foo());
+            EXPECT_FALSE(view.is<MultipleInheritanceData>());
+            EXPECT_ANY_THROW(view.as<const MultipleInheritanceData&>());
+            stack.pop();
+        });
+    }
 }